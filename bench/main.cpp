@@ -0,0 +1,461 @@
+#include "signalgenerator.hpp"
+#include "csdr-sstv.hpp"
+#include "colorconverter.hpp"
+#include <csdr/ringbuffer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace Csdr::Sstv;
+using namespace Csdr::Sstv::Bench;
+
+namespace {
+
+    // an image of the test pattern, as sent by SignalGenerator::addTransmission()
+    class ExpectedImage {
+        public:
+            int vis;
+            // number of lines that are transmitted, 0 for all of them
+            unsigned int lines;
+            // how the decoder is expected to end the image
+            EndReason reason;
+    };
+
+    class Benchmark {
+        public:
+            std::string name;
+            float sampleRate;
+            unsigned int decimation;
+            std::function<std::vector<float>(float sampleRate)> generate;
+            // the images a correct decode produces, empty if there is nothing to check
+            std::vector<ExpectedImage> images;
+            // run the header search alongside DATA
+            bool headerHunt;
+    };
+
+    class Result {
+        public:
+            size_t iterations;
+            double seconds;
+            std::vector<unsigned char> output;
+    };
+
+    // an image as found in the decoder output
+    class DecodedImage {
+        public:
+            OutputDescription description;
+            const unsigned char* pixels;
+            EndDescription end;
+    };
+
+    // mean absolute difference per color value that still counts as a correct decode
+    const double maxError = 10.0;
+
+    // splits the decoder output into images. returns false if it isn't a sequence of complete images.
+    bool parseOutput(const std::vector<unsigned char>& output, std::vector<DecodedImage>& images) {
+        const size_t headerSize = sizeof(outputSync) + sizeof(OutputDescription);
+        const size_t endSize = sizeof(endSync) + sizeof(EndDescription);
+        size_t position = 0;
+        while (position < output.size()) {
+            const unsigned char* data = output.data() + position;
+            if (output.size() - position < headerSize || std::memcmp(data, outputSync, sizeof(outputSync)) != 0) return false;
+            DecodedImage image;
+            std::memcpy(&image.description, data + sizeof(outputSync), sizeof(OutputDescription));
+            size_t imageBytes = (size_t) image.description.pixels * image.description.lines * 3;
+            if (output.size() - position < headerSize + imageBytes + endSize) return false;
+            image.pixels = data + headerSize;
+            const unsigned char* end = image.pixels + imageBytes;
+            if (std::memcmp(end, endSync, sizeof(endSync)) != 0) return false;
+            std::memcpy(&image.end, end + sizeof(endSync), sizeof(EndDescription));
+            images.push_back(image);
+            position += headerSize + imageBytes + endSize;
+        }
+        return true;
+    }
+
+    // the RGB image a perfect decoder produces from the test pattern. the components are converted like
+    // SstvDecoder::convertLineData() does.
+    std::vector<unsigned char> getExpectedPixels(Mode* mode) {
+        const size_t pixels = mode->getHorizontalPixels();
+        const size_t lineBytes = pixels * 3;
+        std::vector<unsigned char> image(lineBytes * mode->getVerticalLines());
+        // YUV420 keeps the previous line in the first two planes
+        std::vector<unsigned char> planes(pixels * 4);
+        auto plane = [&planes, pixels] (unsigned int i) { return planes.data() + i * pixels; };
+        ColorMode colorMode = mode->getColorMode();
+        for (unsigned int line = 0; line < mode->getVerticalLines(); line += mode->getLinesPerLineSync()) {
+            unsigned int first = colorMode == YUV420 && line % 2 ? 2 : 0;
+            for (unsigned int i = 0; i < mode->getComponentCount(); i++) {
+                for (unsigned int x = 0; x < pixels; x++) {
+                    plane(first + i)[x] = SignalGenerator::getPatternValue(mode, x, line, i);
+                }
+            }
+            unsigned char* dst = image.data() + line * lineBytes;
+            switch (colorMode) {
+                case BW:
+                    ColorConverter::convertBW(plane(0), 1, pixels, dst);
+                    break;
+                case RGB:
+                case GBR:
+                    for (unsigned int i = 0; i < 3; i++) {
+                        unsigned int channel = colorMode == GBR ? (i + 1) % 3 : i;
+                        for (size_t x = 0; x < pixels; x++) dst[x * 3 + channel] = plane(i)[x];
+                    }
+                    break;
+                case YUV422:
+                    ColorConverter::convertYUV(plane(0), plane(1), plane(2), 1, pixels, dst);
+                    break;
+                case YUV420:
+                    // Cr comes with the even lines, Cb with the odd ones
+                    if (line % 2 == 0) break;
+                    ColorConverter::convertYUV(plane(0), plane(1), plane(3), 1, pixels, dst - lineBytes);
+                    ColorConverter::convertYUV(plane(2), plane(1), plane(3), 1, pixels, dst);
+                    break;
+                case YUV420PD:
+                    ColorConverter::convertYUV(plane(0), plane(1), plane(2), 1, pixels, dst);
+                    ColorConverter::convertYUV(plane(3), plane(1), plane(2), 1, pixels, dst + lineBytes);
+                    break;
+            }
+        }
+        return image;
+    }
+
+    // compares the decoder output with the expected images. returns false if images are missing, incomplete or not
+    // ended as expected, otherwise error is the mean absolute difference per color value over all transmitted lines.
+    bool verify(const Benchmark& benchmark, const std::vector<unsigned char>& output, double& error) {
+        std::vector<DecodedImage> images;
+        if (!parseOutput(output, images) || images.size() != benchmark.images.size()) return false;
+        double sum = 0.0;
+        size_t count = 0;
+        for (size_t i = 0; i < images.size(); i++) {
+            const ExpectedImage& expected = benchmark.images[i];
+            const DecodedImage& image = images[i];
+            if (image.description.vis != expected.vis) return false;
+            Mode* mode = Mode::fromVis(expected.vis);
+            if (image.description.pixels != mode->getHorizontalPixels() || image.description.lines != mode->getVerticalLines()) return false;
+            unsigned int lines = expected.lines > 0 ? expected.lines : mode->getVerticalLines();
+            if (image.end.reason != expected.reason || image.end.lines != lines) return false;
+            std::vector<unsigned char> pixels = getExpectedPixels(mode);
+            size_t values = (size_t) lines * mode->getHorizontalPixels() * 3;
+            for (size_t k = 0; k < values; k++) {
+                sum += std::abs((int) image.pixels[k] - (int) pixels[k]);
+            }
+            count += values;
+        }
+        error = count > 0 ? sum / (double) count : 0.0;
+        return true;
+    }
+
+    // runs the whole signal through a fresh decoder, feeding it in blocks like a real pipeline would
+    std::vector<unsigned char> decode(const Benchmark& benchmark, const std::vector<float>& signal) {
+        SstvDecoder decoder(benchmark.sampleRate, benchmark.decimation);
+        Csdr::Ringbuffer<float> input((size_t) (benchmark.sampleRate * 16));
+        Csdr::RingbufferReader<float> inputReader(&input);
+        Csdr::Ringbuffer<unsigned char> output(1 << 22);
+        Csdr::RingbufferReader<unsigned char> outputReader(&output);
+        decoder.setLogSink(nullptr);
+        decoder.setHeaderHunt(benchmark.headerHunt);
+        decoder.setEndRecords(true);
+        decoder.setReader(&inputReader);
+        decoder.setWriter(&output);
+
+        const size_t blockSize = 4096;
+        size_t position = 0;
+        std::vector<unsigned char> result;
+        while (position < signal.size()) {
+            size_t length = std::min(std::min(blockSize, input.writeable()), signal.size() - position);
+            std::memcpy(input.getWritePointer(), signal.data() + position, length * sizeof(float));
+            input.advance(length);
+            position += length;
+            while (decoder.canProcess()) decoder.process();
+            size_t available = outputReader.available();
+            result.insert(result.end(), outputReader.getReadPointer(), outputReader.getReadPointer() + available);
+            outputReader.advance(available);
+        }
+        return result;
+    }
+
+    Result run(const Benchmark& benchmark, const std::vector<float>& signal, double minTime) {
+        Result result = { .iterations = 0, .seconds = 0.0, .output = {} };
+        // repeat until the measurement is long enough to be meaningful
+        while (result.iterations == 0 || result.seconds < minTime) {
+            auto start = std::chrono::steady_clock::now();
+            result.output = decode(benchmark, signal);
+            result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.iterations++;
+        }
+        return result;
+    }
+
+    std::vector<Benchmark> createBenchmarks() {
+        std::vector<Benchmark> benchmarks;
+
+        // the sync search on input without any SSTV signal, which is what the decoder sees most of the time
+        benchmarks.push_back(Benchmark {
+            .name = "sync/noise",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(30);
+                return generator.finish();
+            },
+            .images = {},
+            .headerHunt = false,
+        });
+        // a steady tone close to the leader frequency keeps the full sync search busy
+        benchmarks.push_back(Benchmark {
+            .name = "sync/tone",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                options.noise = 50;
+                SignalGenerator generator(options);
+                generator.addTone(1900, 30);
+                return generator.finish();
+            },
+            .images = {},
+            .headerHunt = false,
+        });
+        // headers followed by a VIS code that has no mode, which goes through VIS decoding and mode recovery
+        benchmarks.push_back(Benchmark {
+            .name = "vis/unsupported",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                for (int i = 0; i < 10; i++) {
+                    generator.addSilence(1);
+                    generator.addCalibrationHeader();
+                    generator.addVis(127);
+                }
+                generator.addSilence(3);
+                return generator.finish();
+            },
+            .images = {},
+            .headerHunt = false,
+        });
+
+        for (int visCode: { 8, 12, 44, 40, 60, 56, 76, 28, 63, 55, 93, 99, 95, 98, 96, 97, 94 }) {
+            benchmarks.push_back(Benchmark {
+                .name = "data/" + std::string(Mode::getName(visCode)),
+                .sampleRate = 12000,
+                .decimation = 1,
+                .generate = [visCode] (float sampleRate) {
+                    SignalOptions options;
+                    options.sampleRate = sampleRate;
+                    SignalGenerator generator(options);
+                    generator.addSilence(.5);
+                    generator.addTransmission(visCode);
+                    generator.addSilence(2);
+                    return generator.finish();
+                },
+                .images = { { visCode, 0, END_COMPLETE } },
+                .headerHunt = false,
+            });
+        }
+
+        // reception impairments, on a mode with a line sync on every line and one with a line sync in the middle
+        class Variant {
+            public:
+                std::string name;
+                std::function<void(SignalOptions&)> apply;
+        };
+        const std::vector<Variant> variants = {
+            { "noise", [] (SignalOptions& options) { options.noise = 60; } },
+            { "offset", [] (SignalOptions& options) { options.offset = 80; } },
+            { "lsb", [] (SignalOptions& options) { options.invert = true; } },
+            { "skew", [] (SignalOptions& options) { options.skew = 1.0005; } },
+            { "drift", [] (SignalOptions& options) { options.drift = 1; } },
+        };
+        for (int visCode: { 44, 60 }) {
+            for (auto& variant: variants) {
+                auto apply = variant.apply;
+                benchmarks.push_back(Benchmark {
+                    .name = "data/" + std::string(Mode::getName(visCode)) + "/" + variant.name,
+                    .sampleRate = 12000,
+                    .decimation = 1,
+                    .generate = [visCode, apply] (float sampleRate) {
+                        SignalOptions options;
+                        options.sampleRate = sampleRate;
+                        apply(options);
+                        SignalGenerator generator(options);
+                        generator.addSilence(.5);
+                        generator.addTransmission(visCode);
+                        generator.addSilence(2);
+                        return generator.finish();
+                    },
+                    .images = { { visCode, 0, END_COMPLETE } },
+                    .headerHunt = false,
+                });
+            }
+        }
+
+        // 48kHz input decimated by the decoder
+        benchmarks.push_back(Benchmark {
+            .name = "data/Martin 1/decimation",
+            .sampleRate = 48000,
+            .decimation = 4,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(.5);
+                generator.addTransmission(44);
+                generator.addSilence(2);
+                return generator.finish();
+            },
+            .images = { { 44, 0, END_COMPLETE } },
+            .headerHunt = false,
+        });
+
+        // a transmission that stops after 40 lines, followed by nothing or by a steady carrier. both have to end the
+        // image once the signal has been gone for a while.
+        for (float tone: { 0.0f, 1500.0f, 1900.0f }) {
+            benchmarks.push_back(Benchmark {
+                .name = "data/Martin 1/" + (tone > 0 ? "cut off, " + std::to_string((int) tone) + "Hz tone" : std::string("cut off")),
+                .sampleRate = 12000,
+                .decimation = 1,
+                .generate = [tone] (float sampleRate) {
+                    SignalOptions options;
+                    options.sampleRate = sampleRate;
+                    SignalGenerator generator(options);
+                    generator.addSilence(.5);
+                    generator.addTransmission(44, 40);
+                    if (tone > 0) {
+                        generator.addTone(tone, 120);
+                    } else {
+                        generator.addSilence(120);
+                    }
+                    return generator.finish();
+                },
+                .images = { { 44, 40, END_SIGNAL_LOST } },
+                .headerHunt = false,
+            });
+        }
+
+        // the header search alongside DATA on a regular image, on images that follow each other right away, and on
+        // images that are interrupted by the next
+        benchmarks.push_back(Benchmark {
+            .name = "data/Martin 1/hunt",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(.5);
+                generator.addTransmission(44);
+                generator.addSilence(2);
+                return generator.finish();
+            },
+            .images = { { 44, 0, END_COMPLETE } },
+            .headerHunt = true,
+        });
+        benchmarks.push_back(Benchmark {
+            .name = "data/Martin 1/interrupted",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(.5);
+                generator.addTransmission(44, 128);
+                generator.addTransmission(44);
+                generator.addSilence(2);
+                return generator.finish();
+            },
+            .images = { { 44, 128, END_PREEMPTED }, { 44, 0, END_COMPLETE } },
+            .headerHunt = true,
+        });
+        benchmarks.push_back(Benchmark {
+            .name = "data/Scottie 2/back to back",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(.5);
+                generator.addTransmission(44);
+                generator.addTransmission(56);
+                generator.addSilence(2);
+                return generator.finish();
+            },
+            .images = { { 44, 0, END_COMPLETE }, { 56, 0, END_COMPLETE } },
+            .headerHunt = true,
+        });
+        benchmarks.push_back(Benchmark {
+            .name = "data/Scottie 2/interrupted twice",
+            .sampleRate = 12000,
+            .decimation = 1,
+            .generate = [] (float sampleRate) {
+                SignalOptions options;
+                options.sampleRate = sampleRate;
+                SignalGenerator generator(options);
+                generator.addSilence(.5);
+                generator.addTransmission(56, 60);
+                generator.addTransmission(56, 60);
+                generator.addTransmission(56);
+                generator.addSilence(2);
+                return generator.finish();
+            },
+            .images = { { 56, 60, END_PREEMPTED }, { 56, 60, END_PREEMPTED }, { 56, 0, END_COMPLETE } },
+            .headerHunt = true,
+        });
+
+        return benchmarks;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    // usage: csdr-sstv-bench [filter] [minimum time per benchmark in seconds]
+    std::string filter = argc > 1 ? argv[1] : "";
+    double minTime = argc > 2 ? std::stod(argv[2]) : .5;
+
+    std::printf("%-36s %12s %10s %16s %10s %8s %s\n", "Benchmark", "Time", "Iterations", "Samples/s", "Realtime", "Error", "Output");
+    for (auto& benchmark: createBenchmarks()) {
+        if (benchmark.name.find(filter) == std::string::npos) continue;
+        std::vector<float> signal = benchmark.generate(benchmark.sampleRate);
+        Result result = run(benchmark, signal, minTime);
+        double perIteration = result.seconds / (double) result.iterations;
+        double samplesPerSecond = (double) signal.size() / perIteration;
+        const char* status = "";
+        std::string error = "";
+        if (!benchmark.images.empty()) {
+            double meanError;
+            if (!verify(benchmark, result.output, meanError)) {
+                status = "INCOMPLETE";
+            } else {
+                status = meanError <= maxError ? "ok" : "ERRORS";
+                char buffer[16];
+                std::snprintf(buffer, sizeof(buffer), "%.2f", meanError);
+                error = buffer;
+            }
+        }
+        std::printf(
+            "%-36s %9.2f ms %10zu %14.3fM %9.0fx %8s %s\n",
+            benchmark.name.c_str(),
+            perIteration * 1000,
+            result.iterations,
+            samplesPerSecond / 1e6,
+            samplesPerSecond / benchmark.sampleRate,
+            error.c_str(),
+            status
+        );
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include "signalgenerator.hpp"
+
+using namespace Csdr::Sstv::Bench;
+
+SignalGenerator::SignalGenerator(SignalOptions options): options(options), random(options.seed) {}
+
+void SignalGenerator::addTone(float frequency, double duration) {
+    double samples = duration * options.sampleRate * options.skew + remainder;
+    auto count = (size_t) samples;
+    remainder = samples - (double) count;
+    track.insert(track.end(), count, frequency);
+}
+
+void SignalGenerator::addSilence(double duration) {
+    // no carrier means the demodulator outputs noise spread over the whole band
+    std::uniform_real_distribution<double> distribution(-options.sampleRate / 2, options.sampleRate / 2);
+    double samples = duration * options.sampleRate * options.skew + remainder;
+    auto count = (size_t) samples;
+    remainder = samples - (double) count;
+    for (size_t i = 0; i < count; i++) track.push_back(distribution(random));
+}
+
+void SignalGenerator::addCalibrationHeader() {
+    addTone(1900, .3);
+    addTone(1200, .01);
+    addTone(1900, .3);
+}
+
+void SignalGenerator::addVis(int visCode) {
+    // start bit, 7 data bits LSB first, even parity, stop bit
+    addTone(1200, .03);
+    bool parity = false;
+    for (int i = 0; i < 7; i++) {
+        bool bit = (visCode >> i) & 1;
+        parity ^= bit;
+        addTone(bit ? 1100 : 1300, .03);
+    }
+    addTone(parity ? 1100 : 1300, .03);
+    addTone(1200, .03);
+}
+
+void SignalGenerator::addImage(Mode* mode, unsigned int lines) {
+    unsigned int pixels = mode->getHorizontalPixels();
+    if (lines == 0 || lines > mode->getVerticalLines()) lines = mode->getVerticalLines();
+    for (unsigned int line = 0; line < lines; line += mode->getLinesPerLineSync()) {
+        for (unsigned int i = 0; i < mode->getComponentCount(); i++) {
+            // the first line always starts with a sync pulse
+            if (mode->getLineSyncPosition() == i || (line == 0 && i == 0)) {
+                addTone(1200, mode->getLineSyncDuration());
+            }
+            if (!mode->hasComponentSync()) {
+                addTone(1500, mode->getComponentSyncDuration(i));
+            } else if (i > 0) {
+                addTone(1200, mode->getComponentSyncDuration(i));
+            }
+            double pixelDuration = mode->getComponentDuration(i) / pixels;
+            for (unsigned int x = 0; x < pixels; x++) {
+                addTone(1500 + getPatternValue(mode, x, line, i) / 255.0f * 800, pixelDuration);
+            }
+        }
+    }
+}
+
+void SignalGenerator::addTransmission(int visCode, unsigned int lines) {
+    addCalibrationHeader();
+    addVis(visCode);
+    addImage(Mode::fromVis(visCode), lines);
+}
+
+unsigned char SignalGenerator::getPatternValue(Mode* mode, unsigned int x, unsigned int line, unsigned int component) {
+    // diagonal gradients, shifted per component
+    return (unsigned char) ((x * 255 / mode->getHorizontalPixels() + line * 3 + component * 60) % 256);
+}
+
+std::vector<float> SignalGenerator::finish() {
+    std::normal_distribution<double> distribution(0.0, options.noise > 0 ? options.noise : 1.0);
+    std::vector<float> output(track.size());
+    for (size_t i = 0; i < track.size(); i++) {
+        double frequency = track[i] + options.offset + options.drift * (double) i / options.sampleRate;
+        if (options.noise > 0) frequency += distribution(random);
+        if (options.invert) frequency = -frequency;
+        output[i] = (float) (frequency / (options.sampleRate / 2));
+    }
+    return output;
+}
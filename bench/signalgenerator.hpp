@@ -0,0 +1,55 @@
+#pragma once
+
+#include "modes.hpp"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace Csdr::Sstv::Bench {
+
+    class SignalOptions {
+        public:
+            float sampleRate = 12000.0;
+            // standard deviation of gaussian noise added to the track, in Hz
+            float noise = 0.0;
+            // frequency offset of the whole signal, in Hz
+            float offset = 0.0;
+            // change of the offset over time, in Hz per second
+            float drift = 0.0;
+            // lower sideband reception flips the track around 0 Hz
+            bool invert = false;
+            // ratio between the actual and the nominal duration of everything, e.g. 1.0005 for a 500ppm clock error
+            double skew = 1.0;
+            uint32_t seed = 1;
+    };
+
+    // generates the frequency track (as produced by an FM demodulator, normalized to the nyquist frequency) of
+    // SSTV transmissions. all timing comes from the Mode classes. the output only depends on the options, so runs
+    // can be compared.
+    class SignalGenerator {
+        public:
+            explicit SignalGenerator(SignalOptions options = SignalOptions());
+            void addTone(float frequency, double duration);
+            // noise only, i.e. no signal at all
+            void addSilence(double duration);
+            // leader, break, leader
+            void addCalibrationHeader();
+            void addVis(int visCode);
+            // a test pattern with the geometry of the mode. lines > 0 stops the image early, like an interrupted
+            // transmission.
+            void addImage(Mode* mode, unsigned int lines = 0);
+            // header, VIS and image
+            void addTransmission(int visCode, unsigned int lines = 0);
+            // the value addImage() sends for a pixel of a component, 0 - 255
+            static unsigned char getPatternValue(Mode* mode, unsigned int x, unsigned int line, unsigned int component);
+            // applies noise, offset, drift and inversion and returns the result
+            std::vector<float> finish();
+        private:
+            SignalOptions options;
+            std::vector<double> track;
+            // fractional sample carried over between tones
+            double remainder = 0.0;
+            std::mt19937 random;
+    };
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "syncdetector.hpp"
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // fixed-capacity window over the most recent sync candidates. a monotonic queue keeps track of the minimum
+    // error, so pushing, popping and querying the best candidate are all amortized O(1) and allocation-free.
+    class CandidateTracker {
+        public:
+            explicit CandidateTracker(size_t capacity);
+            bool empty() const { return count == 0; }
+            bool full() const { return count == capacity; }
+            size_t size() const { return count; }
+            // add the candidate for the current position. must not be called when full.
+            void push(const Metrics& metrics);
+            // remove the oldest candidate
+            void pop();
+            void clear();
+            // move the current position forward by amount samples
+            void advance(size_t amount) { clock += amount; }
+            // the candidate with the lowest error. if there are multiple, this returns the oldest one.
+            const Metrics& getBest() const;
+            // number of samples between the best candidate and the current position
+            size_t getBestAge() const;
+            bool isBestOldest() const;
+        private:
+            class Entry {
+                public:
+                    Metrics metrics;
+                    uint64_t position;
+            };
+            size_t capacity;
+            // ring buffer of all candidates, indexed by sequence number
+            std::vector<Entry> entries;
+            uint64_t pushed = 0;
+            size_t count = 0;
+            // ring buffer of sequence numbers with increasing error
+            std::vector<uint64_t> queue;
+            size_t queueStart = 0;
+            size_t queueCount = 0;
+            uint64_t clock = 0;
+
+            const Entry& entry(uint64_t sequence) const { return entries[sequence % capacity]; }
+            uint64_t& queueAt(size_t index) { return queue[(queueStart + index) % capacity]; }
+            const uint64_t& queueAt(size_t index) const { return queue[(queueStart + index) % capacity]; }
+    };
+
+}
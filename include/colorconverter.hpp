@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Csdr::Sstv {
+
+    // converts whole lines of decoded components to interleaved 8 bit RGB.
+    // component inputs are read with the given stride so that they can be taken from interleaved pixel data.
+    class ColorConverter {
+        public:
+            static void convertBW(const unsigned char* y, size_t stride, size_t pixels, unsigned char* dst);
+            static void convertYUV(const unsigned char* y, const unsigned char* cr, const unsigned char* cb, size_t stride, size_t pixels, unsigned char* dst);
+    };
+
+}
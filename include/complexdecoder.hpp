@@ -0,0 +1,44 @@
+#pragma once
+
+#include "csdr-sstv.hpp"
+#include <csdr/complex.hpp>
+#include <csdr/module.hpp>
+#include <csdr/ringbuffer.hpp>
+#include <complex>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // decodes SSTV from complex baseband (e.g. an SSB slice) instead of a demodulated frequency track. the input is
+    // low-pass filtered to the SSTV band, decimated and put through the FM discriminator in a single pass, and the
+    // resulting track is decoded by an internal SstvDecoder, so no separate demodulator stage is needed.
+    // USB and LSB slices both work since the decoder detects the inverted track on its own, and a mistuned slice
+    // shows up as the usual frequency offset.
+    class ComplexSstvDecoder: public Csdr::Module<Csdr::complex<float>, unsigned char> {
+        public:
+            // same parameters as SstvDecoder
+            explicit ComplexSstvDecoder(float sampleRate = 12000.0, unsigned int decimation = 1);
+            void setWriter(Csdr::Writer<unsigned char>* writer) override;
+            bool canProcess() override;
+            void process() override;
+            // for everything else that can be configured on a decoder
+            SstvDecoder& getDecoder() { return decoder; }
+        private:
+            unsigned int factor;
+            // filtering the input before the discriminator keeps the noise outside of the SSTV band from turning
+            // into clicks in the track
+            std::vector<float> taps;
+            // circular delay line, stored twice so that the filter can always read it in one piece
+            std::vector<std::complex<float>> delay;
+            size_t delayPosition = 0;
+            unsigned int phase = 0;
+            std::complex<float> previous = 0.0f;
+
+            Csdr::Ringbuffer<float> track;
+            Csdr::RingbufferReader<float> trackReader;
+            SstvDecoder decoder;
+
+            void demodulate();
+    };
+
+}
@@ -1,85 +1,272 @@
 #pragma once
 
 #include <csdr/module.hpp>
-#include <vector>
+#include <csdr/ringbuffer.hpp>
 #include "modes.hpp"
-
-#define SAMPLERATE 12000.0
+#include "syncdetector.hpp"
+#include "candidatetracker.hpp"
+#include "decimator.hpp"
+#include "lineplan.hpp"
+#include "pixelkernel.hpp"
+#include "leadergate.hpp"
+#include "modeprobe.hpp"
+#include "slantcorrector.hpp"
+#include "previewgenerator.hpp"
+#include "statistics.hpp"
+#include "logging.hpp"
 
 namespace Csdr::Sstv {
 
-    enum DecoderState { SYNC, DATA };
-
-    class Metrics {
-        public:
-            float error;
-            float offset;
-            int8_t invert;
-            bool operator < (Metrics other) {
-                return error < other.error;
-            }
-    };
-
-    class StdDevResult {
-        public:
-            float average;
-            float deviation;
-    };
+    enum DecoderState { SYNC, PROBE, DATA };
 
     struct OutputDescription {
         // lets reserve 2 bytes for extended vis codes
         uint16_t vis;
         uint16_t pixels;
         uint16_t lines;
+        // always 0. makes the alignment padding explicit so that the output doesn't contain uninitialized memory.
+        uint16_t reserved;
         float error;
         float offset;
         float visError;
     };
 
-    char outputSync[4] = { 'S', 'Y', 'N', 'C' };
+    extern char outputSync[4];
+
+    enum EndReason { END_COMPLETE, END_SIGNAL_LOST, END_PREEMPTED };
+
+    // written after the last line of every image if enabled, see SstvDecoder::setEndRecords()
+    struct EndDescription {
+        uint16_t vis;
+        // number of lines that were actually decoded, not counting the lines that led to END_SIGNAL_LOST. when an
+        // image ends early, the missing lines are filled with black so that the image still has the size announced
+        // in its OutputDescription.
+        uint16_t lines;
+        // one of EndReason
+        uint16_t reason;
+        uint16_t reserved;
+    };
+
+    // every end of image record starts with this marker, followed by an EndDescription
+    extern char endSync[4];
+
+    // quality of one transmitted line, see SstvDecoder::setLineInfoWriter()
+    struct LineInfo {
+        uint16_t vis;
+        // index of the first image line this record describes, and the number of image lines transmitted with it
+        uint16_t line;
+        uint16_t count;
+        // 1 if the line sync pulse was found, 0 if the search timed out
+        uint8_t syncFound;
+        uint8_t reserved;
+        // see SstvDecoder::getLineConfidence()
+        float confidence;
+        // distance of the line sync pulse from where it was expected, in samples
+        float syncDeviation;
+        // frequency offset used for the line, in the same units as OutputDescription::offset
+        float offset;
+        // estimated standard deviation of the pixel noise, in 0 - 255 units
+        float noise;
+    };
+
+    // every line info record starts with this marker, followed by a LineInfo
+    extern char lineInfoSync[4];
 
     class SstvDecoder: public Csdr::Module<float, unsigned char> {
         public:
-            explicit SstvDecoder();
+            // sampleRate is the rate of the input. if decimation is larger than 1, the input is low-pass filtered and
+            // decimated internally, and decoding runs at sampleRate / decimation.
+            explicit SstvDecoder(float sampleRate = 12000.0, unsigned int decimation = 1);
             ~SstvDecoder() override;
             bool canProcess() override;
             void process() override;
+            // counters for monitoring. safe to read from other threads while the decoder is running.
+            const DecoderStatistics& getStatistics() const { return statistics; }
+            // also measure the time spent in each stage. off by default since reading the clock on every call to
+            // process() is noticeable in the sync search.
+            void setTiming(bool enabled) { timing = enabled; }
+            // diagnostics go to the shared AsyncLogSink by default. pass nullptr to disable logging.
+            void setLogSink(LogSink* sink) { logger.setSink(sink); }
+            // messages below this level are discarded. defaults to LEVEL_INFO, which only reports decoded images.
+            void setLogLevel(LogLevel level) { logger.setLevel(level); }
+            // optional reduced resolution output, see PreviewGenerator. factor is the downsampling factor (e.g. 2 or 4).
+            // takes effect with the next image. pass nullptr to disable.
+            void setPreviewWriter(Csdr::Writer<unsigned char>* writer, unsigned int factor = 4);
+            // optional LineInfo record for every decoded line, so that downstream stages can judge the image while
+            // it is coming in. best effort like the preview: records that don't fit into the writer are dropped.
+            // pass nullptr to disable.
+            void setLineInfoWriter(Csdr::Writer<unsigned char>* writer) { lineInfoWriter = writer; }
+            // keep searching for calibration headers while an image is being decoded. a header with a valid VIS code
+            // ends the current image (END_PREEMPTED) and starts the new one, so that an image that starts before the
+            // previous one is over, or that follows a false trigger, isn't lost. the search needs about a second of
+            // input beyond what a line needs, which delays the output by the same amount. off by default.
+            void setHeaderHunt(bool enabled) { hunting = enabled; }
+            // write an end record (endSync and EndDescription) after the last line of every image. consumers that
+            // expect every image to be followed directly by the next one can't read it, so it is off by default.
+            // early ended images are filled up with black lines either way.
+            void setEndRecords(bool enabled) { endRecords = enabled; }
+            // maximum number of steps (sync search strides or lines) per call to process(), so that a caller running
+            // many decoders can take turns between them. 0, the default, works through all available input.
+            void setStepLimit(unsigned int limit) { stepLimit = limit; }
+            // how well the sync pulses of the last decoded line matched, from 0 (not found) to 1
+            float getLineConfidence() const { return lineConfidence; }
         private:
+            // sample rate after decimation
+            const float sampleRate;
+
             // image sync
-            const float carrier_1900 = 1900.0 / (SAMPLERATE / 2);
+            const float carrier_1900;
             // image sync and line sync
-            const float carrier_1200 = 1200.0 / (SAMPLERATE / 2);
+            const float carrier_1200;
             // min color
-            const float carrier_1500 = 1500.0 / (SAMPLERATE / 2);
+            const float carrier_1500;
             // max color
-            const float carrier_2300 = 2300.0 / (SAMPLERATE / 2);
+            const float carrier_2300;
             // vis bit high
-            const float carrier_1100 = 1100.0 / (SAMPLERATE / 2);
+            const float carrier_1100;
             // vis bit low
-            const float carrier_1300 = 1300.0 / (SAMPLERATE / 2);
+            const float carrier_1300;
+
+            // VIS code = 10 bits of 30ms each
+            const size_t visLength;
 
             DecoderState state = SYNC;
-            std::vector<Metrics> previous_errors;
+            // calibration header = 300ms + 10ms + 300ms
+            SyncDetector syncDetector;
+            // one candidate per sample for 100 samples (at 12kHz), plus the current one
+            CandidateTracker candidates;
+            // the full sync search only runs while the gate is armed
+            LeaderGate gate;
+            bool gateArmed = false;
+            size_t searchedSinceGate = 0;
+
+            // mode recovery when the VIS code is damaged or missing
+            ModeProbe probe;
+            Metrics probeMetrics;
+            float probeVisError = 0.0;
+            std::vector<uint8_t> syncIndicator;
             Mode* mode = nullptr;
+            uint16_t currentVis = 0;
+            LinePlan* plan = nullptr;
+            // offset of the track after applying invert, i.e. a tone of frequency f shows up as
+            // invert * x - offset = f. measured on the calibration header, then follows the line sync pulses.
             float offset = 0.0;
             // possible values: 1 and -1, should not take other values.
             // 1 is regular (USB), -1 is inverted (LSB)
             int8_t invert = 1;
 
+            Decimator* decimator = nullptr;
+            Csdr::Ringbuffer<float>* decimationBuffer = nullptr;
+            Csdr::RingbufferReader<float>* decimatedReader = nullptr;
+
+            // scratch space for the pixel kernels, sized for the current plan
+            std::vector<float> pixelValues;
+            // one plane per component for the modes that need conversion. YUV420 keeps the planes of the previous
+            // line as well since its chroma is spread over two lines.
+            std::vector<unsigned char> lineBuffer;
+            PreviewGenerator* preview = nullptr;
+            const PixelKernel::QuantizeFunction quantize = PixelKernel::getQuantizeFunction();
+
             uint16_t currentLine = 0;
             float lineOffset = 0.0;
+            // samples consumed since the start of the current image
+            size_t samplePosition = 0;
+            SlantCorrector slant;
+            float lineConfidence = 1.0;
+            Csdr::Writer<unsigned char>* lineInfoWriter = nullptr;
+            // line sync of the current line, for the line info
+            bool lineSyncFound = true;
+            float lineSyncDeviation = 0.0;
+            // sum of the absolute second differences of the pixel values, and their number
+            float lineNoiseSum = 0.0;
+            size_t lineNoiseCount = 0;
+            // sum and sum of squares of the pixel values, for their spread
+            double linePixelSum = 0.0;
+            double linePixelSquareSum = 0.0;
+            size_t linePixelCount = 0;
+            // output lines written for the current image, and how many of them were written before the lost lines
+            uint16_t linesWritten = 0;
+            uint16_t goodLines = 0;
+            // consecutive lines without a line sync, with nothing but noise in them or with no image content at all,
+            // and how many of them end the image. the limit depends on the line period.
+            unsigned int lostLines = 0;
+            unsigned int maxLostLines = 0;
+            // time without a usable line after which the signal is considered gone
+            static constexpr float lostSignalSeconds = 2.0;
+            // pixel noise (see LineInfo) above which a line is considered to be noise only
+            static constexpr float maxLineNoise = 100.0;
+            // spread of the pixel values (same scale) below which a line is a steady carrier rather than an image
+            static constexpr float minLineDeviation = .5;
+            // black lines and end record of the last image that did not fit into the writer yet
+            bool endRecords = false;
+            size_t paddingBytes = 0;
+            bool endPending = false;
+            EndDescription end;
+            // weight of each line sync pulse in the running offset estimate
+            static constexpr float offsetSmoothing = .1;
 
-            Metrics getSyncError(float* input);
-            bool attemptVisDecode(const float* input, Metrics metrics);
-            int getVis(const float* input, float& visError);
+            // the header search alongside DATA. shares the gate with the SYNC state, but has its own windows and
+            // candidates since it runs ahead of the read pointer.
+            bool hunting = false;
+            SyncDetector huntDetector;
+            CandidateTracker huntCandidates;
+            bool huntArmed = false;
+            size_t huntedSinceGate = 0;
+            // next position to search, counted like samplePosition
+            size_t huntPosition = 0;
+
+            DecoderStatistics statistics;
+            bool timing = false;
+            unsigned int stepLimit = 0;
+            Logger logger;
+
+            // the reader that decoding operates on; either the input or the output of the decimation stage
+            Csdr::Reader<float>* getSource() { return decimatedReader != nullptr ? decimatedReader : reader; }
+            void decimate();
+            // one line or one sync search step
+            void step();
+            bool canContinue();
+            Counter* getStageTimer(DecoderState state);
+            bool hasEnoughSamples();
+            Metrics getSyncError(SyncDetector& detector, const float* input);
+            void advanceSync(size_t amount);
+            void skipSync(size_t amount);
+            bool attemptVisDecode(const float* input, Metrics metrics, size_t& headerLength);
+            // the VIS code at input, using the frequency offset and sideband of the calibration header in metrics
+            int getVis(const float* input, Metrics metrics, float& visError, float* softBits, bool& framed);
+            void probeMode();
+            void startImage(int vis, Metrics metrics, float visError);
+            void finishImage(EndReason reason);
+            // search the input ahead of the current line for a new header. returns true if it started a new image.
+            bool hunt();
+            // start the image whose VIS code begins visPosition samples after the read pointer, if it is valid
+            bool preemptImage(size_t visPosition, Metrics metrics);
+            // writes as much of the end of the last image as the writer can take
+            void flushImageEnd();
+            bool canFlushImageEnd();
+            // size of the end record in the output, 0 if disabled
+            size_t getEndRecordLength() const;
+            // the end of the last image is out and the header of the next one fits
+            bool canStartImage();
             static StdDevResult calculateStandardDeviation(const float* input, size_t len);
-            void lineSync(float duration, bool firstSync);
+            // position where the sync pulse ends, relative to the read pointer
+            double findSync(float samples, bool firstSync, float& confidence);
+            void lineSync(float samples, bool firstSync);
+            void trackLineSync(float samples);
+            // update the offset from the level of the sync pulse that ends at edge
+            void trackOffset(double edge, float samples);
 
             void readColorLine();
-            void convertLineData(unsigned char* raw);
-            void convertYUVPixel(unsigned char* dst, uint8_t Y, int Cr, int Cb);
-
-            unsigned char* yuvBackBuffer;
+            void advanceSamples(size_t amount);
+            void advanceTo(double position);
+            void advanceFractional(float samples);
+            unsigned char* getPlane(unsigned int component);
+            void convertLineData();
+            void addLineNoise(const float* values, size_t count);
+            float getLineNoise();
+            // standard deviation of the pixel values of the current line, in 0 - 255 units
+            float getLineDeviation();
+            void writeLineInfo();
     };
 
 }
\ No newline at end of file
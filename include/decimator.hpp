@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // low-pass filter and integer decimation for the instantaneous frequency track.
+    // since the track is normalized to the nyquist frequency, the output is scaled by the decimation factor so that
+    // it is normalized to the nyquist frequency of the output sample rate.
+    class Decimator {
+        public:
+            explicit Decimator(unsigned int factor);
+            unsigned int getFactor() const { return factor; }
+            // consumes all length input samples, returns the number of samples written to output.
+            // output must have room for at least (length / factor + 1) samples.
+            size_t process(const float* input, size_t length, float* output);
+            // windowed sinc low-pass with the cutoff given relative to the sample rate, normalized to the given gain
+            static std::vector<float> designLowpass(size_t length, double cutoff, double gain = 1.0);
+        private:
+            unsigned int factor;
+            std::vector<float> taps;
+            // circular delay line, stored twice so that the filter can always read it in one piece
+            std::vector<float> delay;
+            size_t delayPosition = 0;
+            unsigned int phase = 0;
+    };
+
+}
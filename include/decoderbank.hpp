@@ -0,0 +1,66 @@
+#pragma once
+
+#include "csdr-sstv.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // runs any number of independent decoder channels on a fixed pool of worker threads.
+    // channels are only scheduled when they are notified of new input, so idle channels don't cost anything. every
+    // worker has its own queue and steals work from the others when it runs dry.
+    class SstvDecoderBank {
+        public:
+            // threads = 0 uses one worker per hardware thread
+            explicit SstvDecoderBank(unsigned int threads = 0);
+            ~SstvDecoderBank();
+            // adds a decoder for one input stream. the output is written to writer in the same format as a standalone
+            // SstvDecoder. returns the channel number to be used with notify().
+            size_t addChannel(Csdr::Reader<float>* reader, Csdr::Writer<unsigned char>* writer, float sampleRate = 12000.0, unsigned int decimation = 1);
+            // signal that new samples have been written to the channel's input
+            void notify(size_t channel);
+            // stops all workers. pending work is discarded.
+            void stop();
+        private:
+            class Channel {
+                public:
+                    Channel(float sampleRate, unsigned int decimation): decoder(sampleRate, decimation) {}
+                    SstvDecoder decoder;
+                    // serializes processing in case a channel is picked up twice
+                    std::mutex mutex;
+                    // true while the channel is queued or being processed
+                    std::atomic<bool> scheduled{false};
+                    // worker whose queue the channel is preferably put on
+                    size_t home = 0;
+            };
+            class Worker {
+                public:
+                    std::deque<Channel*> queue;
+                    std::mutex mutex;
+                    std::thread thread;
+            };
+
+            // maximum number of decoder steps (see SstvDecoder::setStepLimit()) per channel before it has to go back
+            // to the queue
+            static const unsigned int sliceSize = 256;
+
+            std::vector<Channel*> channels;
+            std::mutex channelsMutex;
+            std::vector<Worker*> workers;
+            std::mutex sleepMutex;
+            std::condition_variable sleepCondition;
+            std::atomic<size_t> pending{0};
+            std::atomic<bool> running{true};
+
+            // a channel that yields its worker goes to the front of the queue, which its own worker takes last
+            void schedule(Channel* channel, bool yield = false);
+            Channel* take(size_t worker);
+            void run(size_t worker);
+            void processChannel(Channel* channel);
+    };
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Csdr::Sstv {
+
+    // cheap pre-detector for the calibration header. a header starting anywhere in the next stride samples must
+    // have a steady tone in the parts of both leaders that all those candidate positions share, and both leaders
+    // must be on the same frequency. checking this on a decimated set of samples allows the full sync search to be
+    // skipped in steps of stride samples while there is no plausible leader.
+    class LeaderGate {
+        public:
+            LeaderGate(size_t leaderLength, size_t breakLength, size_t stride, size_t step, float maxDeviation, float maxDifference);
+            size_t getStride() const { return stride; }
+            // false if no header can start within [input, input + stride)
+            bool test(const float* input) const;
+        private:
+            size_t starts[2];
+            size_t length;
+            size_t stride;
+            // distance between the samples that are looked at
+            size_t step;
+            float maxDeviation;
+            float maxDifference;
+    };
+
+}
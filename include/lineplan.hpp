@@ -0,0 +1,55 @@
+#pragma once
+
+#include "modes.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // flat, precomputed timing of a mode at a given sample rate. this is compiled once per image so that the line
+    // decoding loop does not need to go through the virtual Mode methods.
+    class LinePlan {
+        public:
+            static const unsigned int maxComponents = 4;
+
+            class Component {
+                public:
+                    // length of the line sync before this component, 0 if there is none
+                    float lineSyncSamples;
+                    // component sync or inter-component gap before the pixel data
+                    float syncSamples;
+                    // length of the pixel data
+                    float samples;
+                    float samplesPerPixel;
+                    // polyphase resampling filter, see PixelKernel
+                    unsigned int tapCount;
+                    const float* taps;
+                    // RGB output channel this component is quantized into directly, -1 if it needs conversion
+                    int outputChannel;
+            };
+
+            LinePlan(Mode* mode, float sampleRate);
+            // not copyable since the components point into filterTaps
+            LinePlan(const LinePlan& other) = delete;
+            LinePlan& operator=(const LinePlan& other) = delete;
+
+            uint16_t pixels;
+            uint16_t lines;
+            uint8_t linesPerLineSync;
+            ColorMode colorMode;
+            bool componentSync;
+            unsigned int componentCount;
+            // length of the line sync
+            float lineSyncSamples;
+            // distance from one line sync to the next
+            float linePeriod;
+            // number of samples that need to be available to decode one line
+            size_t lookahead;
+            // bytes written to the output per decoded line (i.e. per line sync)
+            size_t outputBytes;
+            Component components[maxComponents];
+        private:
+            std::vector<float> filterTaps;
+    };
+
+}
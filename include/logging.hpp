@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    enum LogLevel { LEVEL_DEBUG, LEVEL_INFO, LEVEL_WARNING, LEVEL_ERROR };
+
+    // receives the diagnostic messages of the decoding modules. log() is called from the decoding thread, so
+    // implementations must not block.
+    class LogSink {
+        public:
+            virtual ~LogSink() = default;
+            virtual void log(LogLevel level, const std::string& message) = 0;
+            // shared AsyncLogSink writing to std::cerr, used unless a module is given a different sink
+            static LogSink* getDefault();
+    };
+
+    // hands messages over to a background thread that writes them to a stream. the thread is started with the first
+    // message. messages are dropped instead of waiting when the buffer is full or another thread is logging at the
+    // same time.
+    class AsyncLogSink: public LogSink {
+        public:
+            explicit AsyncLogSink(std::ostream& output = std::cerr, size_t capacity = 1024);
+            ~AsyncLogSink() override;
+            void log(LogLevel level, const std::string& message) override;
+            // number of messages that were dropped
+            uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+        private:
+            class Message {
+                public:
+                    LogLevel level;
+                    std::string text;
+            };
+            std::ostream& output;
+            size_t capacity;
+            std::vector<Message> pending;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::atomic<uint64_t> dropped{0};
+            bool running = true;
+            std::thread thread;
+
+            void run();
+    };
+
+    // per module level filter in front of a sink. messages below the level are discarded before they are formatted.
+    class Logger {
+        public:
+            void setSink(LogSink* sink) { this->sink = sink; }
+            void setLevel(LogLevel level) { this->level = level; }
+            bool isEnabled(LogLevel level) const { return sink != nullptr && level >= this->level; }
+            template <typename... T>
+            void log(LogLevel level, const T&... parts) {
+                if (!isEnabled(level)) return;
+                std::ostringstream stream;
+                // writes all parts in order
+                (void) std::initializer_list<int>{ (stream << parts, 0)... };
+                sink->log(level, stream.str());
+            }
+        private:
+            LogSink* sink = LogSink::getDefault();
+            LogLevel level = LEVEL_INFO;
+    };
+
+}
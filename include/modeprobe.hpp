@@ -0,0 +1,60 @@
+#pragma once
+
+#include "modes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // recovers the mode of an image whose VIS code was damaged or missing.
+    // hypotheses come from the VIS bits that were least certain, and optionally from every supported mode. all of
+    // them are tested against the same buffered input by folding the line sync pulses over the line period of each
+    // hypothesis; the correct mode shows one sharp peak.
+    class ModeProbe {
+        public:
+            explicit ModeProbe(float sampleRate);
+            void clear();
+            bool empty() const { return candidates.empty(); }
+            // hypotheses from soft VIS bits: 7 data bits and the parity bit, positive means 1, +-1 is a clean bit.
+            // the count most likely codes with valid parity and a supported mode are added.
+            void addVisCandidates(const float* softBits, unsigned int count);
+            // one hypothesis for each distinct timing of all supported modes
+            void addAllModes();
+            // number of samples evaluate() needs
+            size_t getLookahead() const { return lookahead; }
+            // sync is true for every sample that looks like a line sync pulse (getLookahead() values).
+            // returns the VIS code of the best hypothesis or -1 if none of them fit. position is set to the sample
+            // where decoding of the first line should begin.
+            int evaluate(const uint8_t* sync, float& score, size_t& position);
+        private:
+            class Candidate {
+                public:
+                    int vis;
+                    // sum of the confidence of all VIS bits that had to be flipped. 0 for a clean VIS,
+                    // negative for modes that were not derived from the VIS code.
+                    float cost;
+                    size_t period;
+                    size_t syncLength;
+                    // distance from the start of the line to the line sync pulse, for modes that don't start with it
+                    size_t syncPosition;
+                    float score;
+                    // position of the line sync pulses within the period
+                    size_t phase;
+            };
+            float sampleRate;
+            // minimum time span that is evaluated
+            float minDuration = 2.0;
+            // fraction of sync samples in the pulses minus the fraction in between
+            float minScore = .5;
+            std::vector<Candidate> candidates;
+            std::vector<uint32_t> syncCounts;
+            size_t lookahead = 0;
+            // where the first sync pulse candidate was found
+            size_t first = 0;
+
+            void addCandidate(int vis, float cost);
+            void score(Candidate& candidate) const;
+    };
+
+}
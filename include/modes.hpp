@@ -14,7 +14,10 @@ namespace Csdr::Sstv {
     class Mode {
         public:
             virtual ~Mode() = default;
+            // returns a shared instance that must not be deleted, or nullptr if the VIS code is not supported
             static Mode* fromVis(int visCode);
+            // common name of the mode, or nullptr if the VIS code is not supported or has no well known name
+            static const char* getName(int visCode);
             virtual uint16_t getHorizontalPixels() { return getHorizontalPixelsBit() ? 320 : 160;}
             virtual uint16_t getVerticalLines() { return getVerticalLinesBit() ? 240 : 120; }
             virtual bool hasLineSync() { return true; }
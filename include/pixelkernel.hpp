@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Csdr::Sstv {
+
+    class PixelKernel {
+        public:
+            // output[k * stride] = clamp(values[k] * scale + bias, 0, 255), truncated to 8 bits
+            typedef void (*QuantizeFunction)(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride);
+
+            // number of fractional positions the resampling filter is precomputed for
+            static const unsigned int filterPhases = 32;
+            // number of taps per phase for a given pixel length
+            static unsigned int getFilterLength(float samplesPerPixel);
+            // fills taps (filterPhases * getFilterLength() values) with a sinc low-pass at the pixel rate, cut down to
+            // its main lobe. each phase is normalized to unity gain.
+            static void designFilter(float samplesPerPixel, float* taps);
+            // one filtered value per pixel, where the first pixel starts start samples (fractional) after input.
+            // samples before input are never read, the filter is clamped to the first sample instead.
+            static void resample(const float* input, float start, float samplesPerPixel, size_t pixels, const float* taps, unsigned int tapCount, float* output);
+            // the fastest implementation supported by the cpu we're running on
+            static QuantizeFunction getQuantizeFunction();
+
+            static void quantizeScalar(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride);
+    };
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "csdr-sstv.hpp"
+#include "logging.hpp"
+#include <csdr/module.hpp>
+#include <zlib.h>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    // companion module for the SstvDecoder output. it consumes the SYNC / OutputDescription / RGB line stream and
+    // turns every image into a complete PNG file. lines are filtered and deflated as they arrive, so only the
+    // previous line is kept in memory. images that ended early have been filled up by the decoder, so they are
+    // encoded at their full size; the end of image records in between are skipped.
+    class PngEncoder: public Csdr::Module<unsigned char, unsigned char> {
+        public:
+            // level is the zlib compression level (0 - 9)
+            explicit PngEncoder(int level = Z_DEFAULT_COMPRESSION);
+            ~PngEncoder() override;
+            bool canProcess() override;
+            void process() override;
+            // pass nullptr to disable logging
+            void setLogSink(LogSink* sink) { logger.setSink(sink); }
+            void setLogLevel(LogLevel level) { logger.setLevel(level); }
+        private:
+            enum State { HEADER, LINES };
+            State state = HEADER;
+            int level;
+            OutputDescription description;
+            uint16_t currentLine = 0;
+
+            z_stream stream;
+            bool streamActive = false;
+            // raw line data of the previous line, for the filters that look at it
+            std::vector<unsigned char> previousLine;
+            // filter type byte followed by the filtered line
+            std::vector<unsigned char> filteredLine;
+            std::vector<unsigned char> candidateLine;
+            // compressed data that has not been written into a chunk yet
+            std::vector<unsigned char> idatBuffer;
+            // encoded data that did not fit into the writer yet
+            std::vector<unsigned char> pending;
+            size_t pendingPosition = 0;
+            Logger logger;
+
+            size_t getLineBytes() const { return (size_t) description.pixels * 3; }
+            void startImage(const OutputDescription& description);
+            void encodeLine(const unsigned char* line);
+            void finishImage();
+            void filterLine(const unsigned char* line);
+            void deflateData(int flush);
+            void writeChunk(const char* type, const unsigned char* data, size_t length);
+            void flushPending();
+    };
+
+}
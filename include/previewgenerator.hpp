@@ -0,0 +1,46 @@
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Csdr::Sstv {
+
+    struct PreviewHeader {
+        uint16_t vis;
+        // index of this preview line within the preview image
+        uint16_t line;
+        // size of the preview image
+        uint16_t pixels;
+        uint16_t lines;
+    };
+
+    // every preview line starts with this marker, followed by a PreviewHeader and pixels * 3 bytes of RGB
+    extern char previewSync[4];
+
+    // reduced resolution copy of the decoded image for clients that only want to watch. blocks of factor x factor
+    // pixels of the RGB output are averaged into one, and a preview line is emitted for every factor decoded lines.
+    // the preview is best effort: lines that don't fit into the writer are dropped.
+    class PreviewGenerator {
+        public:
+            PreviewGenerator(Csdr::Writer<unsigned char>* writer, unsigned int factor);
+            void startImage(uint16_t vis, uint16_t pixels, uint16_t lines);
+            // one line of interleaved RGB output
+            void addLine(const unsigned char* rgb);
+            // emit what's left of an incomplete block at the end of the image
+            void finishImage();
+        private:
+            Csdr::Writer<unsigned char>* writer;
+            unsigned int factor;
+            PreviewHeader header;
+            // sums of the current block row, 3 per preview pixel
+            std::vector<uint32_t> sums;
+            unsigned int accumulatedLines = 0;
+            // false until the start of the first image
+            bool active = false;
+
+            void emitLine();
+    };
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Csdr::Sstv {
+
+    // estimates the actual line period of an image from the positions of its line sync pulses. a running least
+    // squares fit over all pulses found so far is updated in O(1) per line, so clock errors of the transmitting or
+    // receiving sound card can be compensated while the image is being decoded.
+    class SlantCorrector {
+        public:
+            // largest clock deviation that is accepted, as a fraction of the nominal period
+            static constexpr double maxDeviation = .005;
+
+            // start a new image with the given line period, in samples
+            void reset(double nominalPeriod);
+            // record the position of the sync pulse for line index. pulses that are too far off the fit are ignored.
+            void addSync(unsigned int index, double position);
+            // true once enough pulses have been recorded for the fit to be used
+            bool isValid() const { return valid; }
+            // ratio between the fitted and the nominal line period, 1 if the fit is not valid
+            double getScale() const { return valid ? slope / nominalPeriod : 1.0; }
+            // expected position of the sync pulse for line index. only meaningful if the fit is valid.
+            double predict(unsigned int index) const { return intercept + slope * index; }
+        private:
+            // number of pulses before the fit is used
+            static const unsigned int minCount = 8;
+            // number of consecutive pulses that don't fit before the fit is started over, e.g. after dropped samples
+            static const unsigned int maxRejected = 8;
+
+            double nominalPeriod = 0.0;
+            // running sums for the fit. positions are relative to the first pulse to keep them small.
+            unsigned int count = 0;
+            unsigned int rejected = 0;
+            double origin = 0.0;
+            double sumX = 0.0;
+            double sumY = 0.0;
+            double sumXX = 0.0;
+            double sumXY = 0.0;
+            double slope = 0.0;
+            double intercept = 0.0;
+            bool valid = false;
+
+            void update();
+    };
+
+}
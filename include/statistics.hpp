@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Csdr::Sstv {
+
+    // a counter that is only written by the decoding thread, but can be read from any thread at any time. with a
+    // single writer, an increment doesn't need an atomic read-modify-write, so counting is as cheap as a plain add.
+    class Counter {
+        public:
+            void add(uint64_t amount = 1) {
+                value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+            uint64_t get() const { return value.load(std::memory_order_relaxed); }
+        private:
+            std::atomic<uint64_t> value{0};
+    };
+
+    // everything the decoder counts. sample counts are after decimation. counters are read individually, so a
+    // reader may see one of them updated slightly before another.
+    class DecoderStatistics {
+        public:
+            // samples consumed per state
+            Counter syncSamples;
+            Counter probeSamples;
+            Counter dataSamples;
+
+            // number of leader gate evaluations
+            Counter gateTests;
+            // number of times the gate found leader-like activity
+            Counter gateArmed;
+            // sync samples skipped without running the full sync search
+            Counter skippedSamples;
+            // sync samples that went through the full sync search
+            Counter searchedSamples;
+
+            // positions where the sync search found a possible calibration header
+            Counter syncCandidates;
+            Counter visAttempts;
+            // VIS codes that decoded to a known mode
+            Counter visDecoded;
+            Counter visParityErrors;
+            // no start and stop bits where the VIS was expected
+            Counter visFramingErrors;
+            // mode recovery from the line sync
+            Counter probeAttempts;
+            Counter probeDecoded;
+
+            Counter imagesStarted;
+            // images that were ended early because the signal was lost
+            Counter imagesAborted;
+            // images that were ended by a new header, see SstvDecoder::setHeaderHunt()
+            Counter imagesPreempted;
+            // positions covered by the header search alongside DATA
+            Counter huntedSamples;
+            // output lines, two per sync for the modes that transmit two lines at once
+            Counter linesDecoded;
+            // lines lost because the writer did not have enough space
+            Counter linesDropped;
+            Counter lineSyncHits;
+            Counter lineSyncTimeouts;
+
+            // time spent per stage. only counted while timing is enabled on the decoder.
+            Counter decimationNanoseconds;
+            Counter syncNanoseconds;
+            Counter probeNanoseconds;
+            Counter dataNanoseconds;
+    };
+
+    // adds the time between construction and destruction to a counter. does nothing if the counter is nullptr.
+    class StageTimer {
+        public:
+            explicit StageTimer(Counter* counter):
+                counter(counter),
+                start(counter != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+            {}
+            ~StageTimer() {
+                if (counter == nullptr) return;
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                counter->add((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            }
+        private:
+            Counter* counter;
+            std::chrono::steady_clock::time_point start;
+    };
+
+}
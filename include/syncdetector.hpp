@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Csdr::Sstv {
+
+    class Metrics {
+        public:
+            float error;
+            float offset;
+            int8_t invert;
+            bool operator < (Metrics other) {
+                return error < other.error;
+            }
+    };
+
+    class StdDevResult {
+        public:
+            float average;
+            float deviation;
+    };
+
+    // keeps running sums over the three windows of the calibration header (leader, break, leader) so that their
+    // statistics can be updated in O(1) per sample instead of being recalculated at every candidate position.
+    class SyncDetector {
+        public:
+            static const unsigned int windowCount = 3;
+            SyncDetector(size_t leaderLength, size_t breakLength);
+            // total number of samples covered by the windows
+            size_t getLength() const { return starts[windowCount]; }
+            // forget the current state; the next call to getResults() will recalculate from scratch.
+            void reset();
+            // statistics for the windows starting at input. input must be the position that was passed to the
+            // last slide() (or any position after reset()).
+            const StdDevResult* getResults(const float* input);
+            // move the windows forward by amount samples. must be called with the current position *before*
+            // the samples are consumed since the samples leaving the windows are needed to update the sums.
+            void slide(const float* input, size_t amount);
+        private:
+            size_t starts[windowCount + 1];
+            // double precision to keep the accumulated rounding errors small
+            double sums[windowCount];
+            double squareSums[windowCount];
+            StdDevResult results[windowCount];
+            bool valid = false;
+            // the sums are recalculated periodically to avoid drift
+            size_t slidSamples = 0;
+
+            void recalculate(const float* input);
+    };
+
+}
@@ -0,0 +1,52 @@
+#include "candidatetracker.hpp"
+
+using namespace Csdr::Sstv;
+
+CandidateTracker::CandidateTracker(size_t capacity):
+    capacity(capacity),
+    entries(capacity),
+    queue(capacity)
+{}
+
+void CandidateTracker::push(const Metrics& metrics) {
+    uint64_t sequence = pushed++;
+    entries[sequence % capacity] = Entry {
+        .metrics = metrics,
+        .position = clock,
+    };
+    count++;
+
+    // drop all candidates that are worse than the new one. they can never become the best candidate again.
+    // equal candidates are kept so that the oldest one wins, just like std::min_element() would.
+    while (queueCount > 0 && metrics.error < entry(queueAt(queueCount - 1)).metrics.error) {
+        queueCount--;
+    }
+    queueAt(queueCount++) = sequence;
+}
+
+void CandidateTracker::pop() {
+    if (count == 0) return;
+    uint64_t oldest = pushed - count;
+    if (queueCount > 0 && queueAt(0) == oldest) {
+        queueStart = (queueStart + 1) % capacity;
+        queueCount--;
+    }
+    count--;
+}
+
+void CandidateTracker::clear() {
+    count = 0;
+    queueCount = 0;
+}
+
+const Metrics& CandidateTracker::getBest() const {
+    return entry(queueAt(0)).metrics;
+}
+
+size_t CandidateTracker::getBestAge() const {
+    return (size_t) (clock - entry(queueAt(0)).position);
+}
+
+bool CandidateTracker::isBestOldest() const {
+    return queueAt(0) == pushed - count;
+}
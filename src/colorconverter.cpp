@@ -0,0 +1,60 @@
+#include "colorconverter.hpp"
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+namespace {
+
+    // precomputed chroma contributions and a clamping table for the YCrCb -> RGB conversion:
+    // R = Y + 45 * Cr / 32
+    // G = Y - (11 * Cb + 23 * Cr) / 32
+    // B = Y + 113 * Cb / 64
+    class YuvTables {
+        public:
+            YuvTables() {
+                for (int i = 0; i < 256; i++) {
+                    int c = i - 128;
+                    red[i] = 45 * c / 32;
+                    greenCb[i] = 11 * c;
+                    greenCr[i] = 23 * c;
+                    blue[i] = 113 * c / 64;
+                }
+                for (int i = 0; i < clampSize; i++) {
+                    clamp[i] = (unsigned char) std::min(255, std::max(0, i - clampOffset));
+                }
+            }
+            static const int clampOffset = 384;
+            static const int clampSize = 1024;
+            int red[256];
+            int greenCb[256];
+            int greenCr[256];
+            int blue[256];
+            unsigned char clamp[clampSize];
+    };
+
+    const YuvTables& getTables() {
+        static YuvTables tables;
+        return tables;
+    }
+
+}
+
+void ColorConverter::convertBW(const unsigned char* y, size_t stride, size_t pixels, unsigned char* dst) {
+    for (size_t i = 0; i < pixels; i++) {
+        dst[i * 3] = dst[i * 3 + 1] = dst[i * 3 + 2] = y[i * stride];
+    }
+}
+
+void ColorConverter::convertYUV(const unsigned char* y, const unsigned char* cr, const unsigned char* cb, size_t stride, size_t pixels, unsigned char* dst) {
+    const YuvTables& tables = getTables();
+    const unsigned char* clamp = tables.clamp + YuvTables::clampOffset;
+    for (size_t i = 0; i < pixels; i++) {
+        int Y = y[i * stride];
+        unsigned char Cr = cr[i * stride];
+        unsigned char Cb = cb[i * stride];
+        dst[i * 3] = clamp[Y + tables.red[Cr]];
+        // the sum is divided as a whole to keep the rounding of the original formula
+        dst[i * 3 + 1] = clamp[Y - (tables.greenCb[Cb] + tables.greenCr[Cr]) / 32];
+        dst[i * 3 + 2] = clamp[Y + tables.blue[Cb]];
+    }
+}
@@ -0,0 +1,71 @@
+#include "complexdecoder.hpp"
+#include "decimator.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace Csdr::Sstv;
+
+ComplexSstvDecoder::ComplexSstvDecoder(float sampleRate, unsigned int decimation):
+    Csdr::Module<Csdr::complex<float>, unsigned char>(),
+    factor(std::max(decimation, 1u)),
+    // needs to hold more than the largest lookahead, same as the decimation buffer of the decoder
+    track((size_t) (sampleRate / (float) factor * 8)),
+    trackReader(&track),
+    decoder(sampleRate / (float) factor)
+{
+    // 2300Hz plus room for mistuning, but always below the output nyquist frequency. the transition band is about
+    // 1kHz wide.
+    double cutoff = std::min(3000.0, .45 * sampleRate / factor) / sampleRate;
+    size_t length = (size_t) (5.5 * sampleRate / 1000) | 1;
+    taps = Decimator::designLowpass(length, cutoff);
+    delay.resize(length * 2, 0.0f);
+    decoder.setReader(&trackReader);
+}
+
+void ComplexSstvDecoder::setWriter(Csdr::Writer<unsigned char>* writer) {
+    Csdr::Module<Csdr::complex<float>, unsigned char>::setWriter(writer);
+    decoder.setWriter(writer);
+}
+
+bool ComplexSstvDecoder::canProcess() {
+    if (reader->available() > 0 && track.writeable() > 1) {
+        return true;
+    }
+    return decoder.canProcess();
+}
+
+void ComplexSstvDecoder::process() {
+    // alternate between the stages until the input is used up or the decoder is stuck
+    do {
+        demodulate();
+        if (decoder.canProcess()) decoder.process();
+    } while (reader->available() > 0 && track.writeable() > 1);
+}
+
+void ComplexSstvDecoder::demodulate() {
+    size_t length = std::min(reader->available(), (track.writeable() - 1) * factor);
+    const Csdr::complex<float>* input = reader->getReadPointer();
+    float* output = track.getWritePointer();
+    size_t tapCount = taps.size();
+    size_t produced = 0;
+    for (size_t i = 0; i < length; i++) {
+        delay[delayPosition] = delay[delayPosition + tapCount] = input[i];
+        delayPosition = (delayPosition + 1) % tapCount;
+        if (++phase < factor) continue;
+        phase = 0;
+        // delayPosition now points to the oldest sample
+        const std::complex<float>* history = delay.data() + delayPosition;
+        float re = 0.0, im = 0.0;
+        for (size_t k = 0; k < tapCount; k++) {
+            re += taps[k] * history[k].real();
+            im += taps[k] * history[k].imag();
+        }
+        std::complex<float> sample(re, im);
+        // phase difference to the previous sample, normalized to the nyquist frequency like the demodulated track
+        std::complex<float> product = sample * std::conj(previous);
+        output[produced++] = std::atan2(product.imag(), product.real()) / (float) M_PI;
+        previous = sample;
+    }
+    reader->advance(length);
+    track.advance(produced);
+}
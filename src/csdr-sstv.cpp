@@ -1,107 +1,305 @@
 #include "csdr-sstv.hpp"
-#include <iostream>
+#include "colorconverter.hpp"
 #include <cstring>
 #include <algorithm>
 #include <cmath>
 
 using namespace Csdr::Sstv;
 
-SstvDecoder::SstvDecoder(): Csdr::Module<float, unsigned char>() {
-    yuvBackBuffer = (unsigned char*) malloc(320 * 2);
+char Csdr::Sstv::outputSync[4] = { 'S', 'Y', 'N', 'C' };
+char Csdr::Sstv::endSync[4] = { 'D', 'O', 'N', 'E' };
+char Csdr::Sstv::lineInfoSync[4] = { 'L', 'I', 'N', 'E' };
+
+SstvDecoder::SstvDecoder(float sampleRate, unsigned int decimation):
+    Csdr::Module<float, unsigned char>(),
+    sampleRate(sampleRate / (float) std::max(decimation, 1u)),
+    carrier_1900(1900.0 / (this->sampleRate / 2)),
+    carrier_1200(1200.0 / (this->sampleRate / 2)),
+    carrier_1500(1500.0 / (this->sampleRate / 2)),
+    carrier_2300(2300.0 / (this->sampleRate / 2)),
+    carrier_1100(1100.0 / (this->sampleRate / 2)),
+    carrier_1300(1300.0 / (this->sampleRate / 2)),
+    visLength((size_t) (.03 * this->sampleRate) * 10),
+    syncDetector((size_t) (.3 * this->sampleRate), (size_t) (.01 * this->sampleRate)),
+    candidates((size_t) (this->sampleRate / 120) + 1),
+    gate(
+        (size_t) (.3 * this->sampleRate), (size_t) (.01 * this->sampleRate),
+        // check every quarter of the leader, looking at about 1500 samples per second
+        (size_t) (.3 * this->sampleRate) / 4, std::max((size_t) 1, (size_t) (this->sampleRate / 1500)),
+        // a sync error below .1 allows for at most .3 in each of the header windows, plus some headroom since
+        // the gate looks at a smaller region
+        .35,
+        // the leaders have to be within 100Hz of each other, plus some headroom
+        200.0 / (this->sampleRate / 2)
+    ),
+    probe(this->sampleRate),
+    huntDetector((size_t) (.3 * this->sampleRate), (size_t) (.01 * this->sampleRate)),
+    huntCandidates((size_t) (this->sampleRate / 120) + 1)
+{
+    if (decimation > 1) {
+        decimator = new Decimator(decimation);
+        // needs to hold more than the largest lookahead
+        decimationBuffer = new Csdr::Ringbuffer<float>((size_t) (this->sampleRate * 8));
+        decimatedReader = new Csdr::RingbufferReader<float>(decimationBuffer);
+    }
 }
 
 SstvDecoder::~SstvDecoder() {
-    delete mode;
-    delete yuvBackBuffer;
+    delete plan;
+    delete preview;
+    delete decimatedReader;
+    delete decimationBuffer;
+    delete decimator;
+}
+
+void SstvDecoder::setPreviewWriter(Csdr::Writer<unsigned char>* writer, unsigned int factor) {
+    delete preview;
+    preview = writer != nullptr ? new PreviewGenerator(writer, factor) : nullptr;
 }
 
 bool SstvDecoder::canProcess() {
+    if (canFlushImageEnd()) return true;
+    if (decimator != nullptr && reader->available() > 0 && decimationBuffer->writeable() > 1) {
+        return true;
+    }
+    return hasEnoughSamples();
+}
+
+bool SstvDecoder::hasEnoughSamples() {
+    // the search can lead to a new image at any time, so it waits for the output instead of dropping the end of
+    // the last image
+    if (state != DATA && !canStartImage()) return false;
     switch (state) {
         case SYNC:
             // calibration header = 300ms + 10ms + 300ms
             // VIS code = 30ms * 10;
             // total 910 ms
-            return reader->available() > (size_t) (.91 * SAMPLERATE);
-        case DATA:
-            return reader->available() > (size_t) (mode->getLineDuration() * SAMPLERATE);
+            return getSource()->available() > syncDetector.getLength() + visLength;
+        case PROBE:
+            return getSource()->available() > probe.getLookahead();
+        case DATA: {
+            size_t needed = plan->lookahead;
+            // the header search has to stay ahead of the line that is being decoded
+            if (hunting) needed += syncDetector.getLength() + visLength + gate.getStride();
+            return getSource()->available() > needed;
+        }
     }
     return false;
 }
 
+void SstvDecoder::decimate() {
+    size_t length = std::min(reader->available(), (decimationBuffer->writeable() - 1) * decimator->getFactor());
+    size_t produced = decimator->process(reader->getReadPointer(), length, decimationBuffer->getWritePointer());
+    reader->advance(length);
+    decimationBuffer->advance(produced);
+}
+
+Counter* SstvDecoder::getStageTimer(DecoderState state) {
+    if (!timing) return nullptr;
+    switch (state) {
+        case SYNC:
+            return &statistics.syncNanoseconds;
+        case PROBE:
+            return &statistics.probeNanoseconds;
+        case DATA:
+            return &statistics.dataNanoseconds;
+    }
+    return nullptr;
+}
+
 void SstvDecoder::process() {
-    float* input = reader->getReadPointer();
+    // work through everything that is available instead of returning to the caller after every line or sync step
+    unsigned int steps = 0;
+    flushImageEnd();
+    while (true) {
+        if (decimator != nullptr) {
+            StageTimer timer(timing ? &statistics.decimationNanoseconds : nullptr);
+            decimate();
+        }
+        bool progress = false;
+        while (hasEnoughSamples() && (steps == 0 || canContinue())) {
+            if (stepLimit > 0 && steps >= stepLimit) return;
+            step();
+            steps++;
+            progress = true;
+        }
+        // with decimation, consuming samples makes room for more input
+        if (decimator == nullptr || !progress || reader->available() == 0) return;
+    }
+}
+
+bool SstvDecoder::canContinue() {
+    // when the writer is full, only one line per call is dropped, same as without batching
+    return state != DATA || writer->writeable() >= plan->outputBytes;
+}
+
+void SstvDecoder::step() {
+    StageTimer timer(getStageTimer(state));
+    float* input = getSource()->getReadPointer();
     switch (state) {
         case SYNC: {
-            Metrics m = getSyncError(input);
+            if (!gateArmed) {
+                statistics.gateTests.add();
+                if (!gate.test(input)) {
+                    skipSync(gate.getStride());
+                    break;
+                }
+                statistics.gateArmed.add();
+                gateArmed = true;
+                searchedSinceGate = 0;
+            }
+            Metrics m = getSyncError(syncDetector, input);
             if (m.error < 0.5) {
                 // wait until we have reached the point of least error
-                previous_errors.push_back(m);
-                if (previous_errors.size() > 100) {
-                    auto it = std::min_element(previous_errors.begin(), previous_errors.end());
-                    if (it == previous_errors.begin() && it->error < .1) {
-                        std::cerr << "sync error: " << it->error << "; offset: " << it->offset << "; invert: " << (int) it->invert << std::endl;
-                        offset = it->offset;
-                        invert = it->invert;
-                        if (attemptVisDecode(input + 7220, *it)) {
-                            reader->advance(7220 + 3600 );
+                statistics.syncCandidates.add();
+                candidates.push(m);
+                if (candidates.full()) {
+                    const Metrics& best = candidates.getBest();
+                    if (candidates.isBestOldest() && best.error < .1) {
+                        logger.log(LEVEL_DEBUG, "sync error: ", best.error, "; offset: ", best.offset, "; invert: ", (int) best.invert);
+                        invert = best.invert;
+                        offset = (float) invert * best.offset;
+                        size_t visPosition = syncDetector.getLength() - candidates.getBestAge();
+                        size_t headerLength;
+                        if (attemptVisDecode(input + visPosition, best, headerLength)) {
+                            getSource()->advance(visPosition + headerLength);
+                            statistics.syncSamples.add(visPosition + headerLength);
                             break;
                         }
                     }
-                    previous_errors.erase(previous_errors.begin());
+                    candidates.pop();
                 }
-                reader->advance(1);
+                advanceSync(1);
             } else {
-                if (!previous_errors.empty()) {
-                    auto it = std::min_element(previous_errors.begin(), previous_errors.end());
-                    if (it->error < .1) {
-                        auto age = std::distance(it, previous_errors.end());
-                        std::cerr << "sync error: " << it->error << "; offset: " << it->offset << "; invert: " << (int) it->invert << std::endl;
-                        offset = it->offset;
-                        invert = it->invert;
-                        if (attemptVisDecode(input + 7320 - age, *it)) {
-                            reader->advance((7320 - age) + 3600);
+                if (!candidates.empty()) {
+                    const Metrics& best = candidates.getBest();
+                    if (best.error < .1) {
+                        logger.log(LEVEL_DEBUG, "sync error: ", best.error, "; offset: ", best.offset, "; invert: ", (int) best.invert);
+                        invert = best.invert;
+                        offset = (float) invert * best.offset;
+                        size_t visPosition = syncDetector.getLength() - candidates.getBestAge();
+                        size_t headerLength;
+                        if (attemptVisDecode(input + visPosition, best, headerLength)) {
+                            getSource()->advance(visPosition + headerLength);
+                            statistics.syncSamples.add(visPosition + headerLength);
                             break;
                         }
                     }
                 }
-                previous_errors.clear();
+                candidates.clear();
+                // nothing promising for a while, go back to the cheap pre-detection
+                if (searchedSinceGate >= gate.getStride()) {
+                    gateArmed = false;
+                }
                 // advance quicker if we're not even below threshold
-                reader->advance(10);
+                advanceSync(10);
             }
             break;
         }
+        case PROBE:
+            probeMode();
+            break;
         case DATA: {
+            if (hunting && hunt()) break;
             readColorLine();
-            currentLine += mode->getLinesPerLineSync();
-            if (currentLine >= mode->getVerticalLines()) {
-                currentLine = 0;
-                delete mode;
-                mode = nullptr;
-                state = SYNC;
+            currentLine += plan->linesPerLineSync;
+            if (lostLines >= maxLostLines) {
+                logger.log(LEVEL_INFO, "signal lost after ", goodLines, " lines");
+                statistics.imagesAborted.add();
+                finishImage(END_SIGNAL_LOST);
+            } else if (currentLine >= plan->lines) {
+                finishImage(END_COMPLETE);
             }
             break;
         }
     }
 }
 
-bool SstvDecoder::attemptVisDecode(const float *input, Metrics metrics) {
+bool SstvDecoder::attemptVisDecode(const float *input, Metrics metrics, size_t& headerLength) {
+    statistics.visAttempts.add();
     float visError;
-    int vis = getVis(input, visError);
-    if (vis < 0) return false;
+    float softBits[8];
+    bool framed;
+    int vis = getVis(input, metrics, visError, softBits, framed);
+    // without start and stop bits, the image may follow the calibration header immediately
+    headerLength = framed ? visLength : 0;
 
-    mode = Mode::fromVis(vis);
-    if (mode == nullptr) {
-        std::cerr << "mode not implemented; no mode for vis " << vis << std::endl;
-        return false;
+    if (vis >= 0) {
+        bool confident = true;
+        for (float bit: softBits) {
+            // less than 50Hz away from the decision threshold
+            if (std::fabs(bit) < .5) confident = false;
+        }
+        if (Mode::fromVis(vis) == nullptr) {
+            logger.log(LEVEL_WARNING, "mode not implemented; no mode for vis ", vis);
+        } else if (confident) {
+            statistics.visDecoded.add();
+            startImage(vis, metrics, visError);
+            return true;
+        }
     }
-    std::cerr << "Detected VIS: " << vis << std::endl;
+
+    // the VIS could not be decoded reliably. try to figure out the mode from the image itself.
+    probe.clear();
+    if (framed && visError <= .1) {
+        probe.addVisCandidates(softBits, 4);
+    } else {
+        probe.addAllModes();
+    }
+    if (probe.empty()) return false;
+    probeMetrics = metrics;
+    probeVisError = visError;
+    candidates.clear();
+    syncDetector.reset();
+    gateArmed = false;
+    state = PROBE;
+    return true;
+}
+
+void SstvDecoder::probeMode() {
+    statistics.probeAttempts.add();
+    size_t length = probe.getLookahead();
+    const float* input = getSource()->getReadPointer();
+    // within 100 Hz of carrier, same as lineSync()
+    float threshold = carrier_1200 + 100.0 / (sampleRate / 2);
+    syncIndicator.resize(length);
+    for (size_t i = 0; i < length; i++) {
+        syncIndicator[i] = (float) invert * input[i] - offset <= threshold;
+    }
+
+    float score;
+    size_t position;
+    int vis = probe.evaluate(syncIndicator.data(), score, position);
+    if (vis < 0) {
+        logger.log(LEVEL_INFO, "could not determine mode from line sync");
+        state = SYNC;
+        return;
+    }
+    logger.log(LEVEL_INFO, "mode probe selected VIS ", vis, " (line sync score: ", score, ")");
+    statistics.probeDecoded.add();
+    getSource()->advance(position);
+    statistics.probeSamples.add(position);
+    startImage(vis, probeMetrics, probeVisError);
+}
+
+void SstvDecoder::startImage(int vis, Metrics metrics, float visError) {
+    mode = Mode::fromVis(vis);
+    currentVis = (uint16_t) vis;
+    logger.log(LEVEL_INFO, "Detected VIS: ", vis);
+    plan = new LinePlan(mode, sampleRate);
+    statistics.imagesStarted.add();
+    pixelValues.resize(plan->pixels);
+    lineBuffer.resize((size_t) plan->pixels * plan->componentCount * (plan->colorMode == YUV420 ? 2 : 1));
+
+    if (preview != nullptr) preview->startImage((uint16_t) vis, plan->pixels, plan->lines);
 
     memcpy(writer->getWritePointer(), outputSync, sizeof(outputSync));
     writer->advance(sizeof(outputSync));
     OutputDescription out = {
         .vis = (uint16_t) vis,
-        .pixels = mode->getHorizontalPixels(),
-        .lines = mode->getVerticalLines(),
+        .pixels = plan->pixels,
+        .lines = plan->lines,
+        .reserved = 0,
         .error = metrics.error,
         .offset = metrics.offset,
         .visError = visError,
@@ -109,19 +307,166 @@ bool SstvDecoder::attemptVisDecode(const float *input, Metrics metrics) {
     memcpy(writer->getWritePointer(), &out, sizeof(OutputDescription));
     writer->advance(sizeof(OutputDescription));
 
-    previous_errors.clear();
+    candidates.clear();
+    syncDetector.reset();
+    gateArmed = false;
     lineOffset = 0.0;
+    samplePosition = 0;
+    // the header search starts over with every image
+    huntPosition = 0;
+    huntDetector.reset();
+    huntCandidates.clear();
+    huntArmed = false;
+    slant.reset(plan->linePeriod);
+    linesWritten = 0;
+    goodLines = 0;
+    lostLines = 0;
+    maxLostLines = std::max(3u, (unsigned int) ceilf(lostSignalSeconds * sampleRate / plan->linePeriod));
     state = DATA;
+}
+
+void SstvDecoder::finishImage(EndReason reason) {
+    if (preview != nullptr) preview->finishImage();
+    // fill up the image to the announced size so that consumers counting bytes stay in sync
+    paddingBytes = (size_t) (plan->lines - std::min(linesWritten, plan->lines)) * plan->pixels * 3;
+    end = EndDescription {
+        .vis = currentVis,
+        .lines = reason == END_SIGNAL_LOST ? goodLines : linesWritten,
+        .reason = (uint16_t) reason,
+        .reserved = 0,
+    };
+    endPending = true;
+    flushImageEnd();
+
+    currentLine = 0;
+    delete plan;
+    plan = nullptr;
+    mode = nullptr;
+    state = SYNC;
+}
+
+bool SstvDecoder::hunt() {
+    if (huntPosition < samplePosition) {
+        // start over at the read pointer if the search has fallen behind
+        huntPosition = samplePosition;
+        huntDetector.reset();
+        huntCandidates.clear();
+        huntArmed = false;
+    }
+    const float* input = getSource()->getReadPointer();
+    // only search the part of the input that the next line will take up. a header further ahead would otherwise
+    // end the image before the lines in front of it have been decoded, including the last line when the next
+    // image follows right away.
+    const size_t end = std::min((size_t) plan->linePeriod, getSource()->available() - syncDetector.getLength() - visLength);
+    // the same steps as the SYNC state, on the input ahead of the current line
+    while (huntPosition - samplePosition < end) {
+        size_t position = huntPosition - samplePosition;
+        const float* current = input + position;
+        size_t amount;
+        if (!huntArmed && !gate.test(current)) {
+            huntDetector.reset();
+            huntCandidates.clear();
+            amount = gate.getStride();
+        } else {
+            if (!huntArmed) {
+                huntArmed = true;
+                huntedSinceGate = 0;
+            }
+            Metrics m = getSyncError(huntDetector, current);
+            if (m.error < 0.5) {
+                huntCandidates.push(m);
+                if (huntCandidates.full()) {
+                    const Metrics& best = huntCandidates.getBest();
+                    size_t visPosition = position + syncDetector.getLength() - huntCandidates.getBestAge();
+                    if (huntCandidates.isBestOldest() && best.error < .1 && preemptImage(visPosition, best)) return true;
+                    huntCandidates.pop();
+                }
+                amount = 1;
+            } else {
+                if (!huntCandidates.empty()) {
+                    const Metrics& best = huntCandidates.getBest();
+                    size_t visPosition = position + syncDetector.getLength() - huntCandidates.getBestAge();
+                    if (best.error < .1 && preemptImage(visPosition, best)) return true;
+                }
+                huntCandidates.clear();
+                if (huntedSinceGate >= gate.getStride()) huntArmed = false;
+                amount = 10;
+            }
+            huntDetector.slide(current, amount);
+            huntedSinceGate += amount;
+        }
+        huntCandidates.advance(amount);
+        huntPosition += amount;
+        statistics.huntedSamples.add(amount);
+    }
+    return false;
+}
+
+bool SstvDecoder::preemptImage(size_t visPosition, Metrics metrics) {
+    statistics.visAttempts.add();
+    float visError;
+    float softBits[8];
+    bool framed;
+    int vis = getVis(getSource()->getReadPointer() + visPosition, metrics, visError, softBits, framed);
+    // only a clean VIS code is reason enough to give up on the current image, there is no mode probe here
+    if (vis < 0 || Mode::fromVis(vis) == nullptr) return false;
+    for (float bit: softBits) {
+        if (std::fabs(bit) < .5) return false;
+    }
+    // the rest of the current image and the new header have to fit, or the output would be out of sync
+    size_t required = (size_t) (plan->lines - std::min(linesWritten, plan->lines)) * plan->pixels * 3 +
+        getEndRecordLength() + sizeof(outputSync) + sizeof(OutputDescription);
+    if (endPending || writer->writeable() < required) {
+        logger.log(LEVEL_WARNING, "no room to end the current image; ignoring VIS ", vis);
+        return false;
+    }
+
+    logger.log(LEVEL_INFO, "new header while decoding; ending image after ", linesWritten, " lines");
+    statistics.imagesPreempted.add();
+    statistics.visDecoded.add();
+    finishImage(END_PREEMPTED);
+    // the lines in front of the header belong to the image that has just been ended
+    getSource()->advance(visPosition + visLength);
+    statistics.syncSamples.add(visPosition + visLength);
+    invert = metrics.invert;
+    offset = (float) invert * metrics.offset;
+    startImage(vis, metrics, visError);
     return true;
 }
 
-Metrics SstvDecoder::getSyncError(float *input) {
+bool SstvDecoder::canFlushImageEnd() {
+    if (!endPending) return false;
+    return writer->writeable() >= (paddingBytes > 0 ? 1 : getEndRecordLength());
+}
 
-    StdDevResult m[3] = {
-        calculateStandardDeviation(input, 3600),
-        calculateStandardDeviation(input + 3600, 120),
-        calculateStandardDeviation(input + 3720, 3600),
-    };
+size_t SstvDecoder::getEndRecordLength() const {
+    return endRecords ? sizeof(endSync) + sizeof(EndDescription) : 0;
+}
+
+bool SstvDecoder::canStartImage() {
+    return !endPending && writer->writeable() >= sizeof(outputSync) + sizeof(OutputDescription);
+}
+
+void SstvDecoder::flushImageEnd() {
+    if (!canFlushImageEnd()) return;
+    if (paddingBytes > 0) {
+        size_t length = std::min(paddingBytes, writer->writeable());
+        memset(writer->getWritePointer(), 0, length);
+        writer->advance(length);
+        paddingBytes -= length;
+        if (!canFlushImageEnd()) return;
+    }
+    if (endRecords) {
+        memcpy(writer->getWritePointer(), endSync, sizeof(endSync));
+        memcpy(writer->getWritePointer() + sizeof(endSync), &end, sizeof(EndDescription));
+        writer->advance(sizeof(endSync) + sizeof(EndDescription));
+    }
+    endPending = false;
+}
+
+Metrics SstvDecoder::getSyncError(SyncDetector& detector, const float *input) {
+
+    const StdDevResult* m = detector.getResults(input);
 
     float targets[3] = {
         carrier_1900,
@@ -130,7 +475,7 @@ Metrics SstvDecoder::getSyncError(float *input) {
     };
 
     // gotta be within 100 Hz
-    float max_deviation = 100.0 / (SAMPLERATE / 2);
+    float max_deviation = 100.0 / (sampleRate / 2);
 
     // try for positive and negative (i.e. USB and LSB)
     for (int8_t factor : { 1, -1 }) {
@@ -138,7 +483,7 @@ Metrics SstvDecoder::getSyncError(float *input) {
         float error = 0.0;
         float offset_sum = 0.0;
         for (unsigned int i = 0; i < 3; i++) {
-            offset = m[i].average - targets[i] * (float) factor;
+            float offset = m[i].average - targets[i] * (float) factor;
             min_offset = std::min(min_offset, offset);
             max_offset = std::max(max_offset, offset);
             offset_sum += offset;
@@ -160,10 +505,30 @@ Metrics SstvDecoder::getSyncError(float *input) {
     };
 }
 
-int SstvDecoder::getVis(const float* input, float& visError) {
+void SstvDecoder::advanceSync(size_t amount) {
+    // the detector needs to see the samples before they are consumed
+    syncDetector.slide(getSource()->getReadPointer(), amount);
+    candidates.advance(amount);
+    getSource()->advance(amount);
+    statistics.syncSamples.add(amount);
+    statistics.searchedSamples.add(amount);
+    searchedSinceGate += amount;
+}
+
+void SstvDecoder::skipSync(size_t amount) {
+    // sliding the detector over skipped samples would be a waste
+    syncDetector.reset();
+    candidates.clear();
+    candidates.advance(amount);
+    getSource()->advance(amount);
+    statistics.syncSamples.add(amount);
+    statistics.skippedSamples.add(amount);
+}
+
+int SstvDecoder::getVis(const float* input, Metrics metrics, float& visError, float* softBits, bool& framed) {
     uint8_t result = 0;
     bool parity = false;
-    unsigned int numSamples = .03 * SAMPLERATE;
+    unsigned int numSamples = visLength / 10;
 
     visError = 0.0;
     StdDevResult results[10];
@@ -173,22 +538,41 @@ int SstvDecoder::getVis(const float* input, float& visError) {
     }
     visError /= 10;
 
+    // distance from the decision threshold, in units of the 100Hz nominal distance. positive values are 1 bits.
+    float bitDistance = 100.0 / (sampleRate / 2);
+    for (unsigned int i = 0; i < 8; i++) {
+        softBits[i] = (carrier_1200 - (float) metrics.invert * (results[i + 1].average - metrics.offset)) / bitDistance;
+    }
+
+    // start and stop bit are both at 1200Hz. if they are not, there is no VIS code at this position.
+    framed = true;
+    for (unsigned int i: { 0, 9 }) {
+        if (std::fabs((float) metrics.invert * (results[i].average - metrics.offset) - carrier_1200) > bitDistance * .75) framed = false;
+    }
+
     if (visError > .1) {
-        std::cerr << "bad overall VIS error: " << visError << std::endl;
+        logger.log(LEVEL_DEBUG, "bad overall VIS error: ", visError);
+        return -1;
+    }
+
+    if (!framed) {
+        statistics.visFramingErrors.add();
+        logger.log(LEVEL_DEBUG, "no VIS start / stop bits");
         return -1;
     }
 
     for (unsigned int i = 0; i < 7; i++) {
-        bool visBit = (float) invert * results[i + 1].average - offset < carrier_1200;
+        bool visBit = softBits[i] > 0;
         result |= visBit << i;
         parity ^= visBit;
     }
-    bool parityBit = (float) invert * results[8].average - offset < carrier_1200;
+    bool parityBit = softBits[7] > 0;
     if (parity != parityBit) {
-        std::cerr << "vis parity check failed (would be vis = " << (int) result << ")" << std::endl;
+        statistics.visParityErrors.add();
+        logger.log(LEVEL_DEBUG, "vis parity check failed (would be vis = ", (int) result, ")");
         return -1;
     }
-    std::cerr << "overall VIS error: " << visError << std::endl;
+    logger.log(LEVEL_DEBUG, "overall VIS error: ", visError);
     return result;
 }
 
@@ -210,144 +594,294 @@ StdDevResult SstvDecoder::calculateStandardDeviation(const float *input, size_t
 }
 
 void SstvDecoder::readColorLine() {
-    if (writer->writeable() < mode->getHorizontalPixels() * 3) {
-        std::cerr << "could not write image data";
+    if (writer->writeable() < plan->outputBytes) {
+        statistics.linesDropped.add(plan->outputBytes / ((size_t) plan->pixels * 3));
+        logger.log(LEVEL_WARNING, "could not write image data");
         return;
     }
 
-    unsigned char pixels[mode->getHorizontalPixels()][mode->getComponentCount()];
+    const uint16_t pixelCount = plan->pixels;
+    const unsigned int componentCount = plan->componentCount;
+    unsigned char* dst = writer->getWritePointer();
+    lineConfidence = 1.0;
+    lineSyncFound = true;
+    lineSyncDeviation = 0.0;
+    lineNoiseSum = 0.0;
+    lineNoiseCount = 0;
+    linePixelSum = 0.0;
+    linePixelSquareSum = 0.0;
+    linePixelCount = 0;
+    // corrects for the clock error once the line period has been measured
+    const float timeScale = (float) slant.getScale();
 
-    for (unsigned int i = 0; i < mode->getComponentCount(); i++) {
-        float lineSamples = mode->getComponentDuration(i) * SAMPLERATE;
-        float samplesPerPixel = lineSamples / mode->getHorizontalPixels();
+    for (unsigned int i = 0; i < componentCount; i++) {
+        const LinePlan::Component& component = plan->components[i];
 
-        if (mode->getLineSyncPosition() == i || (currentLine == 0 && i == 0)) {
-           lineSync(mode->getLineSyncDuration(), currentLine == 0 && i == 0);
+        if (currentLine == 0 && i == 0) {
+            lineSync(plan->lineSyncSamples, true);
+        } else if (component.lineSyncSamples > 0) {
+            trackLineSync(component.lineSyncSamples);
         }
 
-        if (mode->hasComponentSync()) {
+        if (plan->componentSync) {
             if (i > 0) {
-                lineSync(carrier_1200, mode->getComponentSyncDuration(i) * SAMPLERATE);
+                lineSync(component.syncSamples, false);
             }
         } else {
-            reader->advance((size_t) (mode->getComponentSyncDuration(i) * SAMPLERATE));
+            advanceFractional(component.syncSamples * timeScale);
         }
-        float* input = reader->getReadPointer();
-        for (unsigned int k = 0; k < mode->getHorizontalPixels(); k++) {
-            float raw = 0.0;
-            for (unsigned int l = 0; l < (unsigned int) samplesPerPixel; l++) {
-                raw += input[(unsigned int) (k * samplesPerPixel) + l];
-            }
-            raw = (float) invert * (raw / (unsigned int) samplesPerPixel) - offset;
-            if (raw < carrier_1500) {
-                pixels[k][i] = 0;
-            } else if (raw > carrier_2300) {
-                pixels[k][i] = 255;
-            } else {
-                pixels[k][i] = (uint8_t) (((raw - carrier_1500) / (carrier_2300 - carrier_1500)) * 255);
-            }
+        // the pixel data starts lineOffset samples after the read pointer
+        float* input = getSource()->getReadPointer();
+        PixelKernel::resample(input, lineOffset, component.samplesPerPixel * timeScale, pixelCount, component.taps, component.tapCount, pixelValues.data());
+        addLineNoise(pixelValues.data(), pixelCount);
+        // apply USB / LSB and the offset, and map the 1500Hz - 2300Hz range to 0 - 255 in one step
+        float scale = 255.0f / (carrier_2300 - carrier_1500);
+        float multiplier = (float) invert * scale;
+        float bias = -(offset + carrier_1500) * scale;
+        if (component.outputChannel >= 0) {
+            // straight into the interleaved output
+            quantize(pixelValues.data(), pixelCount, multiplier, bias, dst + component.outputChannel, 3);
+        } else {
+            quantize(pixelValues.data(), pixelCount, multiplier, bias, getPlane(i), 1);
         }
-        // try to get better timing precision by keeping a sub-sample floating point offset
-        float to_advance = lineSamples + lineOffset;
-        reader->advance((size_t) to_advance);
-        float integral;
-        lineOffset = modff(to_advance, &integral);
+        advanceFractional(component.samples * timeScale);
+    }
+    convertLineData();
+    if (lineInfoWriter != nullptr) writeLineInfo();
+    if (!lineSyncFound || getLineNoise() > maxLineNoise || getLineDeviation() < minLineDeviation) {
+        lostLines++;
+    } else {
+        lostLines = 0;
+        goodLines = linesWritten;
+    }
+}
+
+void SstvDecoder::addLineNoise(const float* values, size_t count) {
+    // the second difference cancels out smooth image content, leaving mostly the noise
+    for (size_t i = 1; i + 1 < count; i++) {
+        lineNoiseSum += std::fabs(values[i - 1] - 2 * values[i] + values[i + 1]);
+    }
+    if (count > 2) lineNoiseCount += count - 2;
+    for (size_t i = 0; i < count; i++) {
+        linePixelSum += values[i];
+        linePixelSquareSum += (double) values[i] * values[i];
     }
-    convertLineData((unsigned char*) pixels);
+    linePixelCount += count;
+}
+
+float SstvDecoder::getLineNoise() {
+    if (lineNoiseCount == 0) return 0.0;
+    // for gaussian noise, the mean absolute second difference is sqrt(6) * sqrt(2 / pi) times its deviation
+    return lineNoiseSum / (float) lineNoiseCount / 1.9544f * 255.0f / (carrier_2300 - carrier_1500);
+}
+
+float SstvDecoder::getLineDeviation() {
+    if (linePixelCount == 0) return 0.0;
+    // over the pixels of all components, so that a colored line has a spread even if each component is flat
+    double mean = linePixelSum / (double) linePixelCount;
+    double variance = std::max(0.0, linePixelSquareSum / (double) linePixelCount - mean * mean);
+    return (float) sqrt(variance) * 255.0f / (carrier_2300 - carrier_1500);
+}
+
+void SstvDecoder::writeLineInfo() {
+    if (lineInfoWriter->writeable() < sizeof(lineInfoSync) + sizeof(LineInfo)) return;
+    LineInfo info;
+    memset(&info, 0, sizeof(LineInfo));
+    info.vis = currentVis;
+    info.line = currentLine;
+    info.count = plan->linesPerLineSync;
+    info.syncFound = lineSyncFound;
+    info.confidence = lineConfidence;
+    info.syncDeviation = lineSyncDeviation;
+    info.offset = (float) invert * offset;
+    info.noise = getLineNoise();
+    unsigned char* dst = lineInfoWriter->getWritePointer();
+    memcpy(dst, lineInfoSync, sizeof(lineInfoSync));
+    memcpy(dst + sizeof(lineInfoSync), &info, sizeof(LineInfo));
+    lineInfoWriter->advance(sizeof(lineInfoSync) + sizeof(LineInfo));
+}
+
+void SstvDecoder::advanceSamples(size_t amount) {
+    getSource()->advance(amount);
+    samplePosition += amount;
+    statistics.dataSamples.add(amount);
+}
+
+void SstvDecoder::advanceTo(double position) {
+    double distance = std::max(0.0, position - (double) samplePosition);
+    double integral;
+    lineOffset = (float) modf(distance, &integral);
+    advanceSamples((size_t) integral);
+}
+
+void SstvDecoder::advanceFractional(float samples) {
+    // try to get better timing precision by keeping a sub-sample floating point offset
+    float to_advance = samples + lineOffset;
+    advanceSamples((size_t) to_advance);
+    float integral;
+    lineOffset = modff(to_advance, &integral);
 }
 
-void SstvDecoder::convertLineData(unsigned char* raw) {
+unsigned char* SstvDecoder::getPlane(unsigned int component) {
+    unsigned int plane = component;
+    // odd YUV420 lines go to the second set of planes so that the previous line is still available
+    if (plan->colorMode == YUV420 && currentLine % 2) plane += plan->componentCount;
+    return lineBuffer.data() + (size_t) plane * plan->pixels;
+}
+
+void SstvDecoder::convertLineData() {
+    const size_t pixelCount = plan->pixels;
+    const size_t lineBytes = pixelCount * 3;
     unsigned char* dst = writer->getWritePointer();
-    switch (mode->getColorMode()) {
+    size_t outputLines = 1;
+    switch (plan->colorMode) {
         case BW:
-            for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++ ) {
-                dst[i * 3] = dst[i * 3 + 1] = dst[i * 3 + 2] = raw[i];
-            }
-            writer->advance(mode->getHorizontalPixels() * 3);
+            // the luminance has been written to the red channel
+            ColorConverter::convertBW(dst, 3, pixelCount, dst);
             break;
         case RGB:
-            std::memcpy(dst, raw, mode->getHorizontalPixels() * 3);
-            writer->advance(mode->getHorizontalPixels() * 3);
-            break;
         case GBR:
-            for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                // GBR -> RGB color mapping
-                dst[i * 3] = raw[i * 3 + 2];
-                dst[i * 3 + 1] = raw[i * 3];
-                dst[i * 3 + 2] = raw[i * 3 + 1];
-            }
-            writer->advance(mode->getHorizontalPixels() * 3);
+            // already in place
             break;
         case YUV422:
-            for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                convertYUVPixel(dst + i * 3, raw[i * 3], raw[i * 3 + 1] - 128, raw[i * 3 + 2] - 128);
-            }
-            writer->advance(mode->getHorizontalPixels() * 3);
+            ColorConverter::convertYUV(getPlane(0), getPlane(1), getPlane(2), 1, pixelCount, dst);
             break;
-        case YUV420:
-            if (currentLine % 2) {
-                for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                    convertYUVPixel(dst + i * 3, yuvBackBuffer[i * 2], yuvBackBuffer[i * 2 + 1] - 128, raw[i * 2 + 1] - 128);
-                }
-                writer->advance(mode->getHorizontalPixels() * 3);
-                dst = writer->getWritePointer();
-                for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                    convertYUVPixel(dst + i * 3, raw[i * 2], yuvBackBuffer[i * 2 + 1] - 128, raw[i * 2 + 1] - 128);
-                }
-                writer->advance(mode->getHorizontalPixels() * 3);
-            } else {
-                std::memcpy(yuvBackBuffer, raw, mode->getHorizontalPixels() * 2);
+        case YUV420: {
+            if (currentLine % 2 == 0) {
+                outputLines = 0;
+                break;
             }
+            // Y and Cr from the previous line, Cb from this one
+            const unsigned char* previousY = lineBuffer.data();
+            const unsigned char* cr = previousY + pixelCount;
+            const unsigned char* y = cr + pixelCount;
+            const unsigned char* cb = y + pixelCount;
+            ColorConverter::convertYUV(previousY, cr, cb, 1, pixelCount, dst);
+            ColorConverter::convertYUV(y, cr, cb, 1, pixelCount, dst + lineBytes);
+            outputLines = 2;
             break;
+        }
         case YUV420PD:
-            for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                convertYUVPixel(dst + i * 3, raw[i * 4], raw[i * 4 + 1] - 128, raw[i * 4 + 2] - 128);
-            }
-            writer->advance(mode->getHorizontalPixels() * 3);
-            dst = writer->getWritePointer();
-            for (unsigned int i = 0; i < mode->getHorizontalPixels(); i++) {
-                convertYUVPixel(dst + i * 3, raw[i * 4 + 3], raw[i * 4 + 1] - 128, raw[i * 4 + 2] - 128);
-            }
-            writer->advance(mode->getHorizontalPixels() * 3);
+            // two lines of Y sharing Cr and Cb
+            ColorConverter::convertYUV(getPlane(0), getPlane(1), getPlane(2), 1, pixelCount, dst);
+            ColorConverter::convertYUV(getPlane(3), getPlane(1), getPlane(2), 1, pixelCount, dst + lineBytes);
+            outputLines = 2;
             break;
     }
+    if (preview != nullptr) {
+        for (size_t i = 0; i < outputLines; i++) preview->addLine(dst + i * lineBytes);
+    }
+    writer->advance(lineBytes * outputLines);
+    linesWritten += outputLines;
+    statistics.linesDecoded.add(outputLines);
 }
 
-void SstvDecoder::convertYUVPixel(unsigned char *dst, uint8_t Y, int Cr, int Cb) {
-    dst[0] = std::min(255, std::max(0, Y + 45 * Cr / 32));
-    dst[1] = std::min(255, std::max(0, Y - (11 * Cb + 23 * Cr) / 32));
-    dst[2] = std::min(255, std::max(0, Y + 113 * Cb / 64));
-}
-
-void SstvDecoder::lineSync(float duration, bool firstSync) {
+double SstvDecoder::findSync(float samples, bool firstSync, float& confidence) {
     // allow uncertainty of 10%
-    unsigned int timeoutSamples = (unsigned int) (duration * SAMPLERATE * 1.5);
-    float* input = reader->getReadPointer();
+    size_t timeoutSamples = (size_t) (samples * 1.5);
+    const float* input = getSource()->getReadPointer();
     // within 100 Hz of carrier
-    float threshold = carrier_1200 + 100.0 / (SAMPLERATE / 2);
-    unsigned int passedSamples = 0;
+    const float threshold = carrier_1200 + 100.0 / (sampleRate / 2);
+    auto above = [input, threshold, this] (size_t i) { return (float) invert * input[i] - offset > threshold; };
+    size_t passedSamples = 0;
     if (!firstSync) {
-        passedSamples = (unsigned int) (duration * SAMPLERATE * 0.9);
+        passedSamples = (size_t) (samples * 0.9);
     }
+    // 50 samples at 12kHz
+    const size_t to_average = (size_t) (sampleRate / 240);
+
+    // slide a window over the input, counting the samples above threshold. the sync ends where most of the window
+    // is above.
+    size_t count = 0;
+    for (size_t i = 0; i < to_average; i++) count += above(passedSamples + i);
     bool found = false;
-    unsigned int count = 0;
-    unsigned int to_average = 50;
     while (passedSamples < timeoutSamples) {
-        count = 0;
-        for (unsigned int i = 0; i < to_average; i++) {
-            float sample = (float) invert * input[passedSamples + i] - offset;
-            if (sample > threshold) count++;
-        }
         if (count > to_average / 2) {
             found = true;
             break;
         }
+        count += above(passedSamples + to_average);
+        count -= above(passedSamples);
         passedSamples++;
     }
-    unsigned int toMove = passedSamples + (to_average - count);
+    // a steady tone above the threshold has an "edge" right away, but no sync level anywhere. noise moves real edges
+    // around too much to check anything closer to the edge, and can even make the line slip past its pulse, so
+    // anything within the next line period counts.
+    size_t range = std::min(getSource()->available(), std::max(timeoutSamples + to_average, (size_t) plan->linePeriod));
+    bool low = false;
+    for (size_t i = 0; found && !low && i < range; i++) low = !above(i);
+    if (!low) found = false;
     if (!found) {
-        toMove = (unsigned int) (duration * SAMPLERATE);
+        statistics.lineSyncTimeouts.add();
+        confidence = 0.0;
+        return samples;
+    }
+    statistics.lineSyncHits.add();
+
+    // the first sample above threshold, assuming the samples before it in the window are all below
+    size_t edge = passedSamples + (to_average - count);
+
+    // the fraction of samples on the expected side of the edge
+    size_t before = std::min(edge, to_average);
+    size_t matching = 0;
+    for (size_t i = edge - before; i < edge; i++) matching += !above(i);
+    for (size_t i = edge; i < edge + to_average; i++) matching += above(i);
+    confidence = (float) matching / (float) (before + to_average);
+
+    // interpolate where the signal crosses halfway between sync and porch level. the frequency of a sample is
+    // measured against the previous sample, so the actual transition is half a sample after the crossing.
+    const float level = (carrier_1200 + carrier_1500) / 2;
+    for (size_t i = std::max(edge, (size_t) 2) - 1; i <= edge + 1; i++) {
+        float previous = (float) invert * input[i - 1] - offset;
+        float next = (float) invert * input[i] - offset;
+        if (previous < level && next >= level) {
+            return (double) (i - 1) + (level - previous) / (next - previous) + .5;
+        }
     }
-    // std::cerr << "found: " << found << "; moving by " << toMove << " samples; expected: " << duration * SAMPLERATE << std::endl;
-    reader->advance(toMove);
+    return (double) edge;
+}
+
+void SstvDecoder::lineSync(float samples, bool firstSync) {
+    float confidence;
+    double edge = findSync(samples, firstSync, confidence);
+    lineConfidence = std::min(lineConfidence, confidence);
+    if (firstSync) {
+        lineSyncFound = confidence > 0;
+        lineSyncDeviation = confidence > 0 ? (float) (edge - samples) : 0.0f;
+    }
+    if (confidence > 0) trackOffset(edge, samples);
+    advanceTo((double) samplePosition + edge);
+}
+
+void SstvDecoder::trackLineSync(float samples) {
+    float confidence;
+    double edge = findSync(samples, false, confidence);
+    lineConfidence = std::min(lineConfidence, confidence);
+    double position = (double) samplePosition + edge;
+    unsigned int index = currentLine / plan->linesPerLineSync;
+    if (confidence > 0) slant.addSync(index, position);
+    lineSyncFound = confidence > 0;
+    lineSyncDeviation = 0.0;
+    if (confidence > 0) {
+        lineSyncDeviation = (float) (slant.isValid() ? position - slant.predict(index) : edge - samples);
+    }
+    // place the line where the fit says it is. this is more precise than the search for an individual pulse, and
+    // keeps the image straight when the pulse is missing or distorted.
+    if (slant.isValid()) position = slant.predict(index);
+    if (confidence > 0) trackOffset(position - (double) samplePosition, samples);
+    advanceTo(position);
+}
+
+void SstvDecoder::trackOffset(double edge, float samples) {
+    // the middle half of the pulse, away from the transitions
+    double start = std::max(0.0, edge - samples * .75);
+    double end = edge - samples * .25;
+    if (end - start < 2) return;
+    const float* input = getSource()->getReadPointer();
+    float sum = 0.0;
+    for (size_t i = (size_t) start; i < (size_t) end; i++) sum += input[i];
+    float measured = (float) invert * sum / (float) ((size_t) end - (size_t) start) - carrier_1200;
+    // a pulse that is this far off is more likely to be distorted than a sign of drift
+    if (std::fabs(measured - offset) > 50.0 / (sampleRate / 2)) return;
+    offset += offsetSmoothing * (measured - offset);
 }
@@ -0,0 +1,47 @@
+#include "decimator.hpp"
+#include <cmath>
+
+using namespace Csdr::Sstv;
+
+Decimator::Decimator(unsigned int factor): factor(factor) {
+    size_t length = 16 * factor + 1;
+    // keep some distance from the output nyquist frequency
+    taps = designLowpass(length, .45 / factor, factor);
+    delay.resize(length * 2, 0.0);
+}
+
+std::vector<float> Decimator::designLowpass(size_t length, double cutoff, double gain) {
+    std::vector<float> taps(length);
+    double sum = 0.0;
+    for (size_t i = 0; i < length; i++) {
+        double x = (double) i - (double) (length - 1) / 2;
+        double sinc = x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        // blackman window
+        double window = .42 - .5 * cos(2 * M_PI * i / (length - 1)) + .08 * cos(4 * M_PI * i / (length - 1));
+        taps[i] = (float) (sinc * window);
+        sum += taps[i];
+    }
+    for (auto& tap: taps) {
+        tap = (float) (tap * (float) gain / sum);
+    }
+    return taps;
+}
+
+size_t Decimator::process(const float* input, size_t length, float* output) {
+    size_t tapCount = taps.size();
+    size_t produced = 0;
+    for (size_t i = 0; i < length; i++) {
+        delay[delayPosition] = delay[delayPosition + tapCount] = input[i];
+        delayPosition = (delayPosition + 1) % tapCount;
+        if (++phase < factor) continue;
+        phase = 0;
+        // delayPosition now points to the oldest sample
+        const float* history = delay.data() + delayPosition;
+        float acc = 0.0;
+        for (size_t k = 0; k < tapCount; k++) {
+            acc += taps[k] * history[k];
+        }
+        output[produced++] = acc;
+    }
+    return produced;
+}
@@ -0,0 +1,119 @@
+#include "decoderbank.hpp"
+
+using namespace Csdr::Sstv;
+
+SstvDecoderBank::SstvDecoderBank(unsigned int threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(new Worker());
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->thread = std::thread([this, i] { run(i); });
+    }
+}
+
+SstvDecoderBank::~SstvDecoderBank() {
+    stop();
+    for (auto worker: workers) delete worker;
+    for (auto channel: channels) delete channel;
+}
+
+size_t SstvDecoderBank::addChannel(Csdr::Reader<float>* reader, Csdr::Writer<unsigned char>* writer, float sampleRate, unsigned int decimation) {
+    auto channel = new Channel(sampleRate, decimation);
+    channel->decoder.setReader(reader);
+    channel->decoder.setWriter(writer);
+    channel->decoder.setStepLimit(sliceSize);
+    std::lock_guard<std::mutex> lock(channelsMutex);
+    channel->home = channels.size() % workers.size();
+    channels.push_back(channel);
+    return channels.size() - 1;
+}
+
+void SstvDecoderBank::notify(size_t channel) {
+    Channel* c;
+    {
+        std::lock_guard<std::mutex> lock(channelsMutex);
+        if (channel >= channels.size()) return;
+        c = channels[channel];
+    }
+    schedule(c);
+}
+
+void SstvDecoderBank::stop() {
+    if (!running.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_all();
+    }
+    for (auto worker: workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+void SstvDecoderBank::schedule(Channel* channel, bool yield) {
+    // already queued or running; the running worker will check again when it's done
+    if (channel->scheduled.exchange(true)) return;
+    Worker* worker = workers[channel->home];
+    // counted before it is queued so that the counter never drops below zero
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (yield) {
+            worker->queue.push_front(channel);
+        } else {
+            worker->queue.push_back(channel);
+        }
+    }
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    sleepCondition.notify_one();
+}
+
+SstvDecoderBank::Channel* SstvDecoderBank::take(size_t worker) {
+    // own queue first, newest first since its data is most likely to still be in the cache
+    {
+        Worker* own = workers[worker];
+        std::lock_guard<std::mutex> lock(own->mutex);
+        if (!own->queue.empty()) {
+            Channel* channel = own->queue.back();
+            own->queue.pop_back();
+            return channel;
+        }
+    }
+    // steal the oldest work from the others
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker* other = workers[(worker + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(other->mutex);
+        if (!other->queue.empty()) {
+            Channel* channel = other->queue.front();
+            other->queue.pop_front();
+            return channel;
+        }
+    }
+    return nullptr;
+}
+
+void SstvDecoderBank::run(size_t worker) {
+    while (running) {
+        Channel* channel = take(worker);
+        if (channel == nullptr) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this] { return pending > 0 || !running; });
+            continue;
+        }
+        pending--;
+        processChannel(channel);
+    }
+}
+
+void SstvDecoderBank::processChannel(Channel* channel) {
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        // process() stops after sliceSize steps
+        if (channel->decoder.canProcess()) channel->decoder.process();
+        channel->scheduled = false;
+        more = channel->decoder.canProcess();
+    }
+    // stopped at the step limit with input left over, give the other channels a chance
+    if (more) schedule(channel, true);
+}
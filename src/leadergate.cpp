@@ -0,0 +1,34 @@
+#include "leadergate.hpp"
+#include <cmath>
+
+using namespace Csdr::Sstv;
+
+LeaderGate::LeaderGate(size_t leaderLength, size_t breakLength, size_t stride, size_t step, float maxDeviation, float maxDifference):
+    // the part of each leader that is common to all candidate positions
+    starts { stride - 1, leaderLength + breakLength + stride - 1 },
+    length(leaderLength - stride + 1),
+    stride(stride),
+    step(step),
+    maxDeviation(maxDeviation),
+    maxDifference(maxDifference)
+{}
+
+bool LeaderGate::test(const float* input) const {
+    float averages[2];
+    for (unsigned int i = 0; i < 2; i++) {
+        const float* region = input + starts[i];
+        float sum = 0.0;
+        float squareSum = 0.0;
+        size_t count = 0;
+        for (size_t k = 0; k < length; k += step) {
+            sum += region[k];
+            squareSum += region[k] * region[k];
+            count++;
+        }
+        float average = sum / (float) count;
+        float variance = (squareSum - sum * average) / (float) (count - 1);
+        if (variance > maxDeviation * maxDeviation) return false;
+        averages[i] = average;
+    }
+    return std::fabs(averages[0] - averages[1]) < maxDifference;
+}
@@ -0,0 +1,57 @@
+#include "lineplan.hpp"
+#include "pixelkernel.hpp"
+#include "slantcorrector.hpp"
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+LinePlan::LinePlan(Mode* mode, float sampleRate):
+    pixels(mode->getHorizontalPixels()),
+    lines(mode->getVerticalLines()),
+    linesPerLineSync(mode->getLinesPerLineSync()),
+    colorMode(mode->getColorMode()),
+    componentSync(mode->hasComponentSync()),
+    componentCount(std::min(mode->getComponentCount(), maxComponents)),
+    lineSyncSamples(mode->getLineSyncDuration() * sampleRate),
+    linePeriod(lineSyncSamples),
+    // leave room for the slant correction to stretch the line
+    lookahead((size_t) (mode->getLineDuration() * sampleRate * (1 + SlantCorrector::maxDeviation))),
+    // YUV420 emits two lines on every second line sync
+    outputBytes((size_t) pixels * 3 * (colorMode == YUV420 ? 2 : linesPerLineSync))
+{
+    size_t tapsOffsets[maxComponents];
+    size_t totalTaps = 0;
+    for (unsigned int i = 0; i < componentCount; i++) {
+        Component& component = components[i];
+        component.lineSyncSamples = mode->getLineSyncPosition() == i ? lineSyncSamples : 0;
+        component.syncSamples = mode->getComponentSyncDuration(i) * sampleRate;
+        component.samples = mode->getComponentDuration(i) * sampleRate;
+        // with component sync, the line sync takes the place of the first component sync
+        if (i > 0 || !componentSync) linePeriod += component.syncSamples;
+        linePeriod += component.samples;
+
+        component.samplesPerPixel = component.samples / pixels;
+        switch (colorMode) {
+            case BW:
+            case RGB:
+                component.outputChannel = (int) i;
+                break;
+            case GBR:
+                component.outputChannel = (int) (i + 1) % 3;
+                break;
+            default:
+                component.outputChannel = -1;
+        }
+        component.tapCount = PixelKernel::getFilterLength(component.samplesPerPixel);
+        tapsOffsets[i] = totalTaps;
+        totalTaps += (size_t) component.tapCount * PixelKernel::filterPhases;
+    }
+
+    filterTaps.resize(totalTaps);
+    for (unsigned int i = 0; i < componentCount; i++) {
+        Component& component = components[i];
+        float* taps = filterTaps.data() + tapsOffsets[i];
+        PixelKernel::designFilter(component.samplesPerPixel, taps);
+        component.taps = taps;
+    }
+}
@@ -0,0 +1,72 @@
+#include "logging.hpp"
+#include <chrono>
+
+using namespace Csdr::Sstv;
+
+namespace {
+
+    const char* getLevelName(LogLevel level) {
+        switch (level) {
+            case LEVEL_DEBUG:
+                return "debug";
+            case LEVEL_INFO:
+                return "info";
+            case LEVEL_WARNING:
+                return "warning";
+            case LEVEL_ERROR:
+                return "error";
+        }
+        return "unknown";
+    }
+
+}
+
+LogSink* LogSink::getDefault() {
+    static AsyncLogSink sink;
+    return &sink;
+}
+
+AsyncLogSink::AsyncLogSink(std::ostream& output, size_t capacity):
+    output(output),
+    capacity(capacity)
+{
+    pending.reserve(capacity);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+void AsyncLogSink::log(LogLevel level, const std::string& message) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock() || pending.size() >= capacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // processes that never log don't need the thread
+    if (!thread.joinable()) thread = std::thread([this] { run(); });
+    pending.push_back(Message { .level = level, .text = message });
+}
+
+void AsyncLogSink::run() {
+    std::vector<Message> messages;
+    messages.reserve(capacity);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // polling instead of being notified keeps the wakeup out of log()
+        condition.wait_for(lock, std::chrono::milliseconds(50), [this] { return !running; });
+        messages.swap(pending);
+        bool stopping = !running;
+        lock.unlock();
+        for (auto& message: messages) output << getLevelName(message.level) << ": " << message.text << "\n";
+        if (!messages.empty()) output.flush();
+        messages.clear();
+        if (stopping) return;
+        lock.lock();
+    }
+}
@@ -0,0 +1,187 @@
+#include "modeprobe.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace Csdr::Sstv;
+
+ModeProbe::ModeProbe(float sampleRate): sampleRate(sampleRate) {}
+
+void ModeProbe::clear() {
+    candidates.clear();
+    lookahead = 0;
+}
+
+void ModeProbe::addVisCandidates(const float* softBits, unsigned int count) {
+    // the hard decision and the reliability of each bit
+    unsigned int hard = 0;
+    float reliability[8];
+    unsigned int order[8];
+    for (unsigned int i = 0; i < 8; i++) {
+        if (softBits[i] > 0) hard |= 1 << i;
+        reliability[i] = std::fabs(softBits[i]);
+        order[i] = i;
+    }
+    std::sort(order, order + 8, [&reliability] (unsigned int a, unsigned int b) { return reliability[a] < reliability[b]; });
+
+    // try all combinations of flips of the five least reliable bits
+    const unsigned int flippable = 5;
+    class Hypothesis {
+        public:
+            int vis;
+            float cost;
+    };
+    std::vector<Hypothesis> hypotheses;
+    for (unsigned int pattern = 0; pattern < (1 << flippable); pattern++) {
+        unsigned int bits = hard;
+        float cost = 0.0;
+        for (unsigned int k = 0; k < flippable; k++) {
+            if (pattern & (1 << k)) {
+                bits ^= 1 << order[k];
+                cost += reliability[order[k]];
+            }
+        }
+        unsigned int vis = bits & 0x7F;
+        bool parity = false;
+        for (unsigned int i = 0; i < 7; i++) parity ^= (vis >> i) & 1;
+        if (parity != (bool) ((bits >> 7) & 1)) continue;
+        if (Mode::fromVis((int) vis) == nullptr) continue;
+        hypotheses.push_back(Hypothesis { .vis = (int) vis, .cost = cost });
+    }
+    std::sort(hypotheses.begin(), hypotheses.end(), [] (const Hypothesis& a, const Hypothesis& b) { return a.cost < b.cost; });
+    for (unsigned int i = 0; i < hypotheses.size() && i < count; i++) {
+        addCandidate(hypotheses[i].vis, hypotheses[i].cost);
+    }
+}
+
+void ModeProbe::addAllModes() {
+    for (int vis = 0; vis < 128; vis++) {
+        if (Mode::fromVis(vis) != nullptr) addCandidate(vis, -1);
+    }
+}
+
+void ModeProbe::addCandidate(int vis, float cost) {
+    Mode* mode = Mode::fromVis(vis);
+    size_t syncLength = std::max((size_t) 1, (size_t) (mode->getLineSyncDuration() * sampleRate));
+    double period = mode->hasLineSync() ? mode->getLineSyncDuration() : 0.0;
+    // time from the start of the line to the line sync pulse
+    double syncPosition = 0.0;
+    for (unsigned int i = 0; i < mode->getComponentCount(); i++) {
+        double duration = mode->getComponentDuration(i);
+        // modes with component sync don't have one before the first component, see SstvDecoder::readColorLine()
+        if (i > 0 || !mode->hasComponentSync()) duration += mode->getComponentSyncDuration(i);
+        period += duration;
+        if (i < mode->getLineSyncPosition()) syncPosition += duration;
+    }
+    Candidate candidate = {
+        .vis = vis,
+        .cost = cost,
+        .period = (size_t) (period * sampleRate),
+        .syncLength = syncLength,
+        .syncPosition = (size_t) (syncPosition * sampleRate),
+        .score = 0.0,
+        .phase = 0,
+    };
+    for (auto& other: candidates) {
+        // the timing is all that can be told apart here. without a VIS code, the mode with more lines is
+        // preferred since the image would otherwise be cut short.
+        if (other.period == candidate.period && other.syncLength == candidate.syncLength && other.syncPosition == candidate.syncPosition) {
+            if (candidate.cost >= 0) {
+                if (other.cost < 0 || candidate.cost < other.cost) other = candidate;
+            } else if (other.cost < 0 && mode->getVerticalLines() > Mode::fromVis(other.vis)->getVerticalLines()) {
+                other = candidate;
+            }
+            return;
+        }
+    }
+    candidates.push_back(candidate);
+    // at least two full periods after the first pulse, which may come up to a period late
+    size_t required = std::max((size_t) (minDuration * sampleRate), candidate.period * 3) + candidate.syncLength;
+    lookahead = std::max(lookahead, required);
+}
+
+void ModeProbe::score(Candidate& candidate) const {
+    candidate.score = 0.0;
+    candidate.phase = 0;
+    if (first + candidate.syncLength > lookahead) return;
+    size_t periods = (lookahead - first - candidate.syncLength) / candidate.period;
+    // a single pulse says nothing about the period
+    if (periods < 2) return;
+    // fold the sync pulses over the period and find the phase where they line up best
+    uint32_t best = 0;
+    for (size_t phase = 0; phase < candidate.period; phase++) {
+        uint32_t sum = 0;
+        for (size_t k = 0; k < periods; k++) {
+            size_t start = first + phase + k * candidate.period;
+            sum += syncCounts[start + candidate.syncLength] - syncCounts[start];
+        }
+        if (sum > best) {
+            best = sum;
+            candidate.phase = first + phase;
+        }
+    }
+    // noise also triggers the sync indicator, often for most samples. what sets a line sync apart is that the
+    // indicator is mostly off between the pulses, so the score is the fraction of sync samples in the pulses minus
+    // the fraction in the rest of the window.
+    size_t pulseSamples = periods * candidate.syncLength;
+    uint32_t other = syncCounts[lookahead] - syncCounts[first] - best;
+    candidate.score = (float) best / (float) pulseSamples - (float) other / (float) (lookahead - first - pulseSamples);
+}
+
+int ModeProbe::evaluate(const uint8_t* sync, float& score, size_t& position) {
+    score = 0.0;
+    if (candidates.empty()) return -1;
+
+    // prefix sums allow counting the sync samples of any window in O(1)
+    syncCounts.resize(lookahead + 1);
+    syncCounts[0] = 0;
+    for (size_t i = 0; i < lookahead; i++) {
+        syncCounts[i + 1] = syncCounts[i] + sync[i];
+    }
+
+    // the image may not start right away. periods before the first pulse-like run would count as missing pulses
+    // and penalize the short periods, so they are left out.
+    size_t run = lookahead;
+    for (auto& candidate: candidates) run = std::min(run, candidate.syncLength / 2);
+    run = std::max(run, (size_t) 1);
+    first = 0;
+    while (first + run <= lookahead && syncCounts[first + run] - syncCounts[first] < run) first++;
+
+    float best = 0.0;
+    for (auto& candidate: candidates) {
+        this->score(candidate);
+        best = std::max(best, candidate.score);
+    }
+    // most of the expected sync pulses need to be there, with little in between
+    if (best < minScore) return -1;
+
+    // a signal with line period p also fits all hypotheses with a multiple of p, so the shortest period wins among
+    // the ones that fit about equally well, unless the VIS code points to one of them.
+    const Candidate* selected = nullptr;
+    for (auto& candidate: candidates) {
+        if (candidate.score < best * .9) continue;
+        if (selected == nullptr) {
+            selected = &candidate;
+        } else if (candidate.cost >= 0 && (selected->cost < 0 || candidate.cost < selected->cost)) {
+            selected = &candidate;
+        } else if (candidate.cost < 0 && selected->cost < 0 && candidate.period < selected->period) {
+            selected = &candidate;
+        }
+    }
+    score = selected->score;
+
+    // look for the first pulse that is actually there
+    size_t start = selected->phase;
+    while (start + selected->period + selected->syncLength <= lookahead) {
+        if (syncCounts[start + selected->syncLength] - syncCounts[start] > selected->syncLength / 2) break;
+        start += selected->period;
+    }
+    if (selected->syncPosition > 0) {
+        // the line starts before its sync pulse
+        if (start < selected->syncPosition) start += selected->period;
+        position = start - selected->syncPosition;
+    } else {
+        // the middle of the pulse, so that a slightly early estimate doesn't end up in front of it
+        position = start + selected->syncLength / 2;
+    }
+    return selected->vis;
+}
@@ -2,38 +2,134 @@
 
 using namespace Csdr::Sstv;
 
+namespace {
+
+    Mode* createMode(int visCode) {
+        switch (visCode) {
+            // Scottie DX overrides AVT
+            case 76:
+                return new ScottieDXMode();
+            // these don't fit the pattern
+            case 93:
+            case 94:
+            case 95:
+            case 96:
+            case 97:
+            case 98:
+            case 99:
+                return new PDMode(visCode);
+            case 51:
+            case 55:
+            case 59:
+            case 63:
+                return new WraaseSC2Mode(visCode);
+        }
+        int systemCode = (visCode & 0b01110000) >> 4;
+        switch (systemCode) {
+            case SYSTEMCODE_ROBOT:
+                return new RobotMode(visCode);
+            case SYSTEMCODE_WRAASE_SC1:
+                return new WraaseSC1Mode(visCode);
+            case SYSTEMCODE_MARTIN:
+                return new MartinMode(visCode);
+            case SYSTEMCODE_SCOTTIE:
+                return new ScottieMode(visCode);
+            //case SYSTEMCODE_AVT:
+            //    return new AvtMode(visCode);
+        }
+        return nullptr;
+    }
+
+    // modes don't carry any state, so there is one shared instance per VIS code
+    class ModeTable {
+        public:
+            ModeTable() {
+                for (int i = 0; i < size; i++) modes[i] = createMode(i);
+            }
+            ~ModeTable() {
+                for (auto mode: modes) delete mode;
+            }
+            static const int size = 128;
+            Mode* modes[size];
+    };
+
+}
+
 Mode* Mode::fromVis(int visCode) {
+    static ModeTable table;
+    if (visCode < 0 || visCode >= ModeTable::size) return nullptr;
+    return table.modes[visCode];
+}
+
+const char* Mode::getName(int visCode) {
+    if (fromVis(visCode) == nullptr) return nullptr;
     switch (visCode) {
-        // Scottie DX overrides AVT
+        case 0:
+            return "Robot 12";
+        case 4:
+            return "Robot 24";
+        case 8:
+            return "Robot 36";
+        case 12:
+            return "Robot 72";
+        case 1:
+        case 2:
+        case 3:
+            return "Robot B&W 8";
+        case 5:
+        case 6:
+        case 7:
+            return "Robot B&W 12";
+        case 9:
+        case 10:
+        case 11:
+            return "Robot B&W 24";
+        case 13:
+        case 14:
+        case 15:
+            return "Robot B&W 36";
+        case 28:
+            return "Wraase SC-1";
+        case 51:
+            return "Wraase SC-2 30";
+        case 59:
+            return "Wraase SC-2 60";
+        case 63:
+            return "Wraase SC-2 120";
+        case 55:
+            return "Wraase SC-2 180";
+        case 44:
+            return "Martin 1";
+        case 40:
+            return "Martin 2";
+        case 36:
+            return "Martin 3";
+        case 32:
+            return "Martin 4";
+        case 60:
+            return "Scottie 1";
+        case 56:
+            return "Scottie 2";
+        case 52:
+            return "Scottie 3";
+        case 48:
+            return "Scottie 4";
         case 76:
-            return new ScottieDXMode();
-        // these don't fit the pattern
+            return "Scottie DX";
         case 93:
-        case 94:
+            return "PD 50";
+        case 99:
+            return "PD 90";
         case 95:
+            return "PD 120";
+        case 98:
+            return "PD 160";
         case 96:
+            return "PD 180";
         case 97:
-        case 98:
-        case 99:
-            return new PDMode(visCode);
-        case 51:
-        case 55:
-        case 59:
-        case 63:
-            return new WraaseSC2Mode(visCode);
-    }
-    int systemCode = (visCode & 0b01110000) >> 4;
-    switch (systemCode) {
-        case SYSTEMCODE_ROBOT:
-            return new RobotMode(visCode);
-        case SYSTEMCODE_WRAASE_SC1:
-            return new WraaseSC1Mode(visCode);
-        case SYSTEMCODE_MARTIN:
-            return new MartinMode(visCode);
-        case SYSTEMCODE_SCOTTIE:
-            return new ScottieMode(visCode);
-        //case SYSTEMCODE_AVT:
-        //    return new AvtMode(visCode);
+            return "PD 240";
+        case 94:
+            return "PD 290";
     }
     return nullptr;
 }
@@ -0,0 +1,210 @@
+#include "pixelkernel.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXELKERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define PIXELKERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace Csdr::Sstv;
+
+unsigned int PixelKernel::getFilterLength(float samplesPerPixel) {
+    // the samples of the pixel plus one for the fractional start, so that it costs about as much as averaging the
+    // samples of the pixel. even, since the taps are symmetric around the pixel center.
+    return 2 * (unsigned int) ceilf((samplesPerPixel + 1) * .5f);
+}
+
+void PixelKernel::designFilter(float samplesPerPixel, float* taps) {
+    unsigned int tapCount = getFilterLength(samplesPerPixel);
+    // pixel nyquist frequency in cycles per sample
+    double cutoff = std::min(.5, .5 / samplesPerPixel);
+    // taps in front of the sample the pixel center falls into, same as in resample()
+    const unsigned int leading = tapCount / 2 - 1;
+    for (unsigned int p = 0; p < filterPhases; p++) {
+        float* phaseTaps = taps + p * tapCount;
+        double sum = 0.0;
+        for (unsigned int t = 0; t < tapCount; t++) {
+            // distance between the tap and the pixel center, see resample()
+            double d = (double) t - (double) leading - (double) p / filterPhases;
+            // the filter only spans the main lobe, where a tapering window would only take away from the noise
+            // suppression
+            phaseTaps[t] = (float) (d == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * d) / (M_PI * d));
+            sum += phaseTaps[t];
+        }
+        for (unsigned int t = 0; t < tapCount; t++) {
+            phaseTaps[t] = (float) (phaseTaps[t] / sum);
+        }
+    }
+}
+
+void PixelKernel::resample(const float* input, float start, float samplesPerPixel, size_t pixels, const float* taps, unsigned int tapCount, float* output) {
+    const size_t leading = tapCount / 2 - 1;
+    // position of the first pixel center, in samples. sample j is centered at j + .5.
+    const double first = start + samplesPerPixel * .5 - .5;
+    // pixel centers in 1 / filterPhases steps, plus .5 so that truncating rounds to the nearest phase, which is
+    // cheaper than a call into libm. only below 0 with less than one sample per pixel, at the very edge.
+    const double step = (double) samplesPerPixel * filterPhases;
+    double center = first * filterPhases + .5;
+    for (size_t k = 0; k < pixels; k++, center += step) {
+        // split into the sample and the filter phase
+        size_t position = (size_t) std::max(0.0, center);
+        size_t sample = position / filterPhases;
+        const float* phaseTaps = taps + (position % filterPhases) * tapCount;
+        float acc = 0.0f;
+        if (sample >= leading) {
+            const float* samples = input + (sample - leading);
+            // two independent sums, so that the additions don't have to wait for each other. the filter length is
+            // always even.
+            float odd = 0.0f;
+            for (unsigned int t = 0; t < tapCount; t += 2) {
+                acc += phaseTaps[t] * samples[t];
+                odd += phaseTaps[t + 1] * samples[t + 1];
+            }
+            acc += odd;
+        } else {
+            // left edge of the component
+            for (unsigned int t = 0; t < tapCount; t++) {
+                acc += phaseTaps[t] * input[sample + t < leading ? 0 : sample + t - leading];
+            }
+        }
+        output[k] = acc;
+    }
+}
+
+void PixelKernel::quantizeScalar(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride) {
+    for (size_t k = 0; k < length; k++) {
+        float v = std::min(255.0f, std::max(0.0f, values[k] * scale + bias));
+        output[k * stride] = (unsigned char) v;
+    }
+}
+
+namespace {
+
+    inline void storeBlock(const unsigned char* block, size_t length, unsigned char* output, size_t stride) {
+        for (size_t i = 0; i < length; i++) {
+            output[i * stride] = block[i];
+        }
+    }
+
+#ifdef PIXELKERNEL_X86
+
+    __attribute__((target("sse2")))
+    void quantizeSse2(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride) {
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 vbias = _mm_set1_ps(bias);
+        const __m128 vmin = _mm_setzero_ps();
+        const __m128 vmax = _mm_set1_ps(255.0f);
+        alignas(16) unsigned char block[16];
+        size_t k = 0;
+        for (; k + 8 <= length; k += 8) {
+            __m128 a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + k), vscale), vbias);
+            __m128 b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + k + 4), vscale), vbias);
+            a = _mm_min_ps(_mm_max_ps(a, vmin), vmax);
+            b = _mm_min_ps(_mm_max_ps(b, vmin), vmax);
+            __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+            __m128i bytes = _mm_packus_epi16(words, words);
+            if (stride == 1) {
+                _mm_storel_epi64((__m128i*) (output + k), bytes);
+            } else {
+                _mm_store_si128((__m128i*) block, bytes);
+                storeBlock(block, 8, output + k * stride, stride);
+            }
+        }
+        PixelKernel::quantizeScalar(values + k, length - k, scale, bias, output + k * stride, stride);
+    }
+
+    __attribute__((target("avx2")))
+    void quantizeAvx2(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride) {
+        const __m256 vscale = _mm256_set1_ps(scale);
+        const __m256 vbias = _mm256_set1_ps(bias);
+        const __m256 vmin = _mm256_setzero_ps();
+        const __m256 vmax = _mm256_set1_ps(255.0f);
+        alignas(16) unsigned char block[16];
+        size_t k = 0;
+        for (; k + 16 <= length; k += 16) {
+            __m256 a = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(values + k), vscale), vbias);
+            __m256 b = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(values + k + 8), vscale), vbias);
+            a = _mm256_min_ps(_mm256_max_ps(a, vmin), vmax);
+            b = _mm256_min_ps(_mm256_max_ps(b, vmin), vmax);
+            // packs operates within 128 bit lanes, so the lanes need to be put back in order afterwards
+            __m256i words = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+            words = _mm256_permute4x64_epi64(words, 0b11011000);
+            __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+            if (stride == 1) {
+                _mm_storeu_si128((__m128i*) (output + k), bytes);
+            } else {
+                _mm_store_si128((__m128i*) block, bytes);
+                storeBlock(block, 16, output + k * stride, stride);
+            }
+        }
+        quantizeSse2(values + k, length - k, scale, bias, output + k * stride, stride);
+    }
+
+#endif
+
+#ifdef PIXELKERNEL_NEON
+
+    void quantizeNeon(const float* values, size_t length, float scale, float bias, unsigned char* output, size_t stride) {
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        const float32x4_t vbias = vdupq_n_f32(bias);
+        const float32x4_t vmin = vdupq_n_f32(0.0f);
+        const float32x4_t vmax = vdupq_n_f32(255.0f);
+        unsigned char block[8];
+        size_t k = 0;
+        for (; k + 8 <= length; k += 8) {
+            float32x4_t a = vmlaq_f32(vbias, vld1q_f32(values + k), vscale);
+            float32x4_t b = vmlaq_f32(vbias, vld1q_f32(values + k + 4), vscale);
+            a = vminq_f32(vmaxq_f32(a, vmin), vmax);
+            b = vminq_f32(vmaxq_f32(b, vmin), vmax);
+            uint16x8_t words = vcombine_u16(vqmovun_s32(vcvtq_s32_f32(a)), vqmovun_s32(vcvtq_s32_f32(b)));
+            uint8x8_t bytes = vqmovn_u16(words);
+            if (stride == 1) {
+                vst1_u8(output + k, bytes);
+            } else {
+                vst1_u8(block, bytes);
+                storeBlock(block, 8, output + k * stride, stride);
+            }
+        }
+        PixelKernel::quantizeScalar(values + k, length - k, scale, bias, output + k * stride, stride);
+    }
+
+#endif
+
+    class QuantizeSelection {
+        public:
+            QuantizeSelection() {
+#if defined(PIXELKERNEL_X86)
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2")) {
+                    function = quantizeAvx2;
+                    return;
+                }
+                if (__builtin_cpu_supports("sse2")) {
+                    function = quantizeSse2;
+                    return;
+                }
+#elif defined(PIXELKERNEL_NEON)
+                function = quantizeNeon;
+                return;
+#endif
+                function = PixelKernel::quantizeScalar;
+            }
+            PixelKernel::QuantizeFunction function;
+    };
+
+    const QuantizeSelection& getSelection() {
+        static QuantizeSelection selection;
+        return selection;
+    }
+
+}
+
+PixelKernel::QuantizeFunction PixelKernel::getQuantizeFunction() {
+    return getSelection().function;
+}
@@ -0,0 +1,214 @@
+#include "pngencoder.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+namespace {
+
+    const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    // size of the IDAT chunks
+    const size_t chunkSize = 65536;
+    // 3 bytes per pixel, as used by the filters
+    const size_t bpp = 3;
+
+    void putUint32(unsigned char* dst, uint32_t value) {
+        dst[0] = (unsigned char) (value >> 24);
+        dst[1] = (unsigned char) (value >> 16);
+        dst[2] = (unsigned char) (value >> 8);
+        dst[3] = (unsigned char) value;
+    }
+
+    unsigned char paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return (unsigned char) a;
+        if (pb <= pc) return (unsigned char) b;
+        return (unsigned char) c;
+    }
+
+}
+
+PngEncoder::PngEncoder(int level): Csdr::Module<unsigned char, unsigned char>(), level(level) {
+    std::memset(&stream, 0, sizeof(stream));
+}
+
+PngEncoder::~PngEncoder() {
+    if (streamActive) deflateEnd(&stream);
+}
+
+bool PngEncoder::canProcess() {
+    if (pendingPosition < pending.size()) return writer->writeable() > 0;
+    switch (state) {
+        case HEADER:
+            return reader->available() >= sizeof(outputSync) + sizeof(OutputDescription);
+        case LINES:
+            return reader->available() >= getLineBytes();
+    }
+    return false;
+}
+
+void PngEncoder::process() {
+    if (pendingPosition < pending.size()) {
+        flushPending();
+        return;
+    }
+
+    switch (state) {
+        case HEADER: {
+            const unsigned char* input = reader->getReadPointer();
+            size_t available = reader->available() - sizeof(outputSync) - sizeof(OutputDescription);
+            // skip anything up to the next sync marker
+            size_t skip = 0;
+            while (skip <= available && std::memcmp(input + skip, outputSync, sizeof(outputSync)) != 0) skip++;
+            if (skip > available) {
+                reader->advance(skip);
+                break;
+            }
+            OutputDescription description;
+            std::memcpy(&description, input + skip + sizeof(outputSync), sizeof(OutputDescription));
+            reader->advance(skip + sizeof(outputSync) + sizeof(OutputDescription));
+            startImage(description);
+            break;
+        }
+        case LINES:
+            encodeLine(reader->getReadPointer());
+            reader->advance(getLineBytes());
+            if (++currentLine >= description.lines) finishImage();
+            break;
+    }
+
+    flushPending();
+}
+
+void PngEncoder::startImage(const OutputDescription& description) {
+    this->description = description;
+    currentLine = 0;
+
+    if (streamActive) deflateEnd(&stream);
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, level) != Z_OK) {
+        logger.log(LEVEL_ERROR, "could not initialize zlib; dropping image");
+        streamActive = false;
+        return;
+    }
+    streamActive = true;
+
+    size_t lineBytes = getLineBytes();
+    previousLine.assign(lineBytes, 0);
+    filteredLine.resize(lineBytes + 1);
+    candidateLine.resize(lineBytes + 1);
+    idatBuffer.clear();
+
+    pending.insert(pending.end(), pngSignature, pngSignature + sizeof(pngSignature));
+    unsigned char header[13];
+    putUint32(header, description.pixels);
+    putUint32(header + 4, description.lines);
+    // 8 bit depth, truecolor, deflate, adaptive filtering, no interlace
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    writeChunk("IHDR", header, sizeof(header));
+
+    state = description.lines > 0 ? LINES : HEADER;
+}
+
+void PngEncoder::encodeLine(const unsigned char* line) {
+    if (!streamActive) return;
+    filterLine(line);
+    stream.next_in = filteredLine.data();
+    stream.avail_in = (uInt) filteredLine.size();
+    deflateData(Z_NO_FLUSH);
+    std::memcpy(previousLine.data(), line, previousLine.size());
+}
+
+void PngEncoder::finishImage() {
+    state = HEADER;
+    if (!streamActive) return;
+    stream.next_in = nullptr;
+    stream.avail_in = 0;
+    deflateData(Z_FINISH);
+    if (!idatBuffer.empty()) writeChunk("IDAT", idatBuffer.data(), idatBuffer.size());
+    idatBuffer.clear();
+    writeChunk("IEND", nullptr, 0);
+    deflateEnd(&stream);
+    streamActive = false;
+}
+
+void PngEncoder::filterLine(const unsigned char* line) {
+    // try all filter types and pick the one with the lowest sum of absolute values, as recommended by the spec
+    const unsigned char* up = previousLine.data();
+    size_t length = previousLine.size();
+    unsigned long best = 0;
+    for (unsigned char type = 0; type < 5; type++) {
+        unsigned char* out = candidateLine.data();
+        out[0] = type;
+        unsigned long sum = 0;
+        for (size_t i = 0; i < length; i++) {
+            int a = i >= bpp ? line[i - bpp] : 0;
+            int b = up[i];
+            int c = i >= bpp ? up[i - bpp] : 0;
+            unsigned char predictor;
+            switch (type) {
+                case 1: predictor = (unsigned char) a; break;
+                case 2: predictor = (unsigned char) b; break;
+                case 3: predictor = (unsigned char) ((a + b) / 2); break;
+                case 4: predictor = paeth(a, b, c); break;
+                default: predictor = 0;
+            }
+            unsigned char value = (unsigned char) (line[i] - predictor);
+            out[i + 1] = value;
+            sum += value < 128 ? value : 256 - value;
+        }
+        if (type == 0 || sum < best) {
+            best = sum;
+            std::swap(filteredLine, candidateLine);
+        }
+    }
+}
+
+void PngEncoder::deflateData(int flush) {
+    unsigned char buffer[16384];
+    int result;
+    do {
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        result = deflate(&stream, flush);
+        idatBuffer.insert(idatBuffer.end(), buffer, buffer + (sizeof(buffer) - stream.avail_out));
+        if (idatBuffer.size() >= chunkSize) {
+            writeChunk("IDAT", idatBuffer.data(), idatBuffer.size());
+            idatBuffer.clear();
+        }
+    } while (stream.avail_out == 0 || (flush == Z_FINISH && result == Z_OK));
+}
+
+void PngEncoder::writeChunk(const char* type, const unsigned char* data, size_t length) {
+    unsigned char header[8];
+    putUint32(header, (uint32_t) length);
+    std::memcpy(header + 4, type, 4);
+    pending.insert(pending.end(), header, header + 8);
+    if (length > 0) pending.insert(pending.end(), data, data + length);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header + 4, 4);
+    if (length > 0) crc = crc32(crc, data, (uInt) length);
+    unsigned char trailer[4];
+    putUint32(trailer, (uint32_t) crc);
+    pending.insert(pending.end(), trailer, trailer + 4);
+}
+
+void PngEncoder::flushPending() {
+    size_t length = std::min(pending.size() - pendingPosition, writer->writeable());
+    std::memcpy(writer->getWritePointer(), pending.data() + pendingPosition, length);
+    writer->advance(length);
+    pendingPosition += length;
+    if (pendingPosition == pending.size()) {
+        pending.clear();
+        pendingPosition = 0;
+    }
+}
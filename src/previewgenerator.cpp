@@ -0,0 +1,63 @@
+#include "previewgenerator.hpp"
+#include <cstring>
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+char Csdr::Sstv::previewSync[4] = { 'P', 'R', 'E', 'V' };
+
+PreviewGenerator::PreviewGenerator(Csdr::Writer<unsigned char>* writer, unsigned int factor):
+    writer(writer),
+    factor(std::max(factor, 1u))
+{}
+
+void PreviewGenerator::startImage(uint16_t vis, uint16_t pixels, uint16_t lines) {
+    header = PreviewHeader {
+        .vis = vis,
+        .line = 0,
+        .pixels = (uint16_t) (pixels / factor),
+        .lines = (uint16_t) ((lines + factor - 1) / factor),
+    };
+    sums.assign((size_t) header.pixels * 3, 0);
+    accumulatedLines = 0;
+    active = true;
+}
+
+void PreviewGenerator::addLine(const unsigned char* rgb) {
+    if (!active) return;
+    // horizontal box filter, summed up over the lines of the block
+    for (size_t x = 0; x < header.pixels; x++) {
+        const unsigned char* block = rgb + x * factor * 3;
+        uint32_t* sum = sums.data() + x * 3;
+        for (unsigned int k = 0; k < factor; k++) {
+            sum[0] += block[k * 3];
+            sum[1] += block[k * 3 + 1];
+            sum[2] += block[k * 3 + 2];
+        }
+    }
+    if (++accumulatedLines == factor) emitLine();
+}
+
+void PreviewGenerator::finishImage() {
+    if (active && accumulatedLines > 0) emitLine();
+    active = false;
+}
+
+void PreviewGenerator::emitLine() {
+    uint32_t count = factor * accumulatedLines;
+    size_t lineBytes = (size_t) header.pixels * 3;
+    size_t length = sizeof(previewSync) + sizeof(PreviewHeader) + lineBytes;
+    if (writer->writeable() >= length) {
+        unsigned char* dst = writer->getWritePointer();
+        std::memcpy(dst, previewSync, sizeof(previewSync));
+        std::memcpy(dst + sizeof(previewSync), &header, sizeof(PreviewHeader));
+        unsigned char* pixels = dst + sizeof(previewSync) + sizeof(PreviewHeader);
+        for (size_t i = 0; i < lineBytes; i++) {
+            pixels[i] = (unsigned char) ((sums[i] + count / 2) / count);
+        }
+        writer->advance(length);
+    }
+    std::fill(sums.begin(), sums.end(), 0);
+    accumulatedLines = 0;
+    header.line++;
+}
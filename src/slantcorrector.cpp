@@ -0,0 +1,63 @@
+#include "slantcorrector.hpp"
+#include <cmath>
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+void SlantCorrector::reset(double nominalPeriod) {
+    this->nominalPeriod = nominalPeriod;
+    count = 0;
+    rejected = 0;
+    origin = 0.0;
+    sumX = 0.0;
+    sumY = 0.0;
+    sumXX = 0.0;
+    sumXY = 0.0;
+    slope = nominalPeriod;
+    intercept = 0.0;
+    valid = false;
+}
+
+void SlantCorrector::addSync(unsigned int index, double position) {
+    if (count == 0) {
+        origin = position;
+        intercept = position - slope * index;
+    } else {
+        // reject pulses that don't fit the current estimate, i.e. noise or a missed pulse. the tolerance is wide
+        // while there are few pulses, and covers the jitter of the sync search after that.
+        double tolerance = valid ? std::max(2.0, nominalPeriod * .002) : nominalPeriod * .05;
+        if (std::fabs(position - predict(index)) > tolerance) {
+            if (++rejected < maxRejected) return;
+            // the timing has changed for good, start over from this pulse
+            reset(nominalPeriod);
+            origin = position;
+            intercept = position - slope * index;
+        }
+    }
+    rejected = 0;
+
+    double x = index;
+    double y = position - origin;
+    count++;
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+    update();
+}
+
+void SlantCorrector::update() {
+    if (count < 2) return;
+    double n = count;
+    double denominator = n * sumXX - sumX * sumX;
+    if (denominator <= 0.0) return;
+    double fittedSlope = (n * sumXY - sumX * sumY) / denominator;
+    // a clock error of more than maxDeviation (half a percent) means the pulses are not where we think they are
+    if (std::fabs(fittedSlope / nominalPeriod - 1.0) > maxDeviation) {
+        valid = false;
+        return;
+    }
+    slope = fittedSlope;
+    intercept = origin + (sumY - slope * sumX) / n;
+    valid = count >= minCount;
+}
@@ -0,0 +1,66 @@
+#include "syncdetector.hpp"
+#include <cmath>
+#include <algorithm>
+
+using namespace Csdr::Sstv;
+
+SyncDetector::SyncDetector(size_t leaderLength, size_t breakLength) {
+    starts[0] = 0;
+    starts[1] = leaderLength;
+    starts[2] = leaderLength + breakLength;
+    starts[3] = leaderLength * 2 + breakLength;
+}
+
+void SyncDetector::reset() {
+    valid = false;
+}
+
+const StdDevResult* SyncDetector::getResults(const float* input) {
+    if (!valid) recalculate(input);
+
+    for (unsigned int i = 0; i < windowCount; i++) {
+        double len = (double) (starts[i + 1] - starts[i]);
+        double average = sums[i] / len;
+        // sum of squared deviations from the average, equivalent to summing (x - average)^2
+        double sum = squareSums[i] - sums[i] * average;
+        results[i] = StdDevResult {
+            .average = (float) average,
+            .deviation = (float) std::sqrt(std::max(0.0, sum / (len - 1))),
+        };
+    }
+    return results;
+}
+
+void SyncDetector::slide(const float* input, size_t amount) {
+    if (!valid) return;
+
+    slidSamples += amount;
+    if (slidSamples > getLength() * 16) {
+        valid = false;
+        return;
+    }
+
+    for (unsigned int i = 0; i < windowCount; i++) {
+        // samples leaving the window at the front...
+        const float* leaving = input + starts[i];
+        // ... and samples entering at the back
+        const float* entering = input + starts[i + 1];
+        for (size_t k = 0; k < amount; k++) {
+            sums[i] += (double) entering[k] - (double) leaving[k];
+            squareSums[i] += (double) entering[k] * entering[k] - (double) leaving[k] * leaving[k];
+        }
+    }
+}
+
+void SyncDetector::recalculate(const float* input) {
+    for (unsigned int i = 0; i < windowCount; i++) {
+        sums[i] = 0.0;
+        squareSums[i] = 0.0;
+        for (size_t k = starts[i]; k < starts[i + 1]; k++) {
+            sums[i] += input[k];
+            squareSums[i] += (double) input[k] * input[k];
+        }
+    }
+    slidSamples = 0;
+    valid = true;
+}
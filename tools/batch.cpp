@@ -0,0 +1,482 @@
+#include "recording.hpp"
+#include "complexdecoder.hpp"
+#include "csdr-sstv.hpp"
+#include "pngencoder.hpp"
+#include <csdr/reader.hpp>
+#include <csdr/ringbuffer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace Csdr::Sstv;
+using namespace Csdr::Sstv::Tools;
+
+namespace {
+
+    class Options {
+        public:
+            std::string inputDirectory;
+            std::string outputDirectory;
+            // sample rate of frequency track files. wav files have their own.
+            float trackSampleRate = 12000.0;
+            // 0 picks a factor that brings the sample rate close to 12kHz
+            unsigned int decimation = 0;
+            // 0 uses one worker per hardware thread
+            unsigned int threads = 0;
+            // search for new headers while decoding, see SstvDecoder::setHeaderHunt()
+            bool headerHunt = false;
+            bool verbose = false;
+    };
+
+    class ImageResult {
+        public:
+            OutputDescription description;
+            bool complete = false;
+            // from the end of image record, if there was one
+            bool ended = false;
+            EndDescription end;
+            // name of the PNG file, empty until it has been written
+            std::string file;
+    };
+
+    class FileResult {
+        public:
+            std::string name;
+            std::string error;
+            RecordingFormat format = TRACK;
+            float sampleRate = 0.0;
+            unsigned int decimation = 1;
+            size_t samples = 0;
+            double seconds = 0.0;
+            std::vector<ImageResult> images;
+            uint64_t visDecoded = 0;
+            uint64_t probeDecoded = 0;
+            uint64_t linesDecoded = 0;
+            uint64_t imagesAborted = 0;
+            uint64_t imagesPreempted = 0;
+            uint64_t lineSyncHits = 0;
+            uint64_t lineSyncTimeouts = 0;
+    };
+
+    // silence after each recording, so that the decoder can finish what it has started
+    const double padding = 5.0;
+
+    // follows the decoder output to keep track of the images in it, and writes every image to a PNG file
+    class ImageCollector {
+        public:
+            ImageCollector(const std::string& prefix, std::vector<ImageResult>& images, bool verbose):
+                prefix(prefix),
+                images(images),
+                decoderOutput(1 << 22),
+                decoderReader(&decoderOutput),
+                encoderInput(1 << 22),
+                encoderReader(&encoderInput),
+                encoderOutput(1 << 22),
+                encoderOutputReader(&encoderOutput)
+            {
+                encoder.setReader(&encoderReader);
+                encoder.setWriter(&encoderOutput);
+                if (!verbose) encoder.setLogSink(nullptr);
+            }
+            Csdr::Writer<unsigned char>* getWriter() { return &decoderOutput; }
+            // consumes everything that the decoder has written so far
+            void collect();
+        private:
+            std::string prefix;
+            std::vector<ImageResult>& images;
+            Csdr::Ringbuffer<unsigned char> decoderOutput;
+            Csdr::RingbufferReader<unsigned char> decoderReader;
+            Csdr::Ringbuffer<unsigned char> encoderInput;
+            Csdr::RingbufferReader<unsigned char> encoderReader;
+            Csdr::Ringbuffer<unsigned char> encoderOutput;
+            Csdr::RingbufferReader<unsigned char> encoderOutputReader;
+            PngEncoder encoder;
+
+            // image header or end of image record that is being read
+            std::vector<unsigned char> header;
+            // image data bytes still expected for the current image
+            size_t remaining = 0;
+            // PNG output that has not been written to a file yet
+            std::vector<unsigned char> png;
+            size_t pngCount = 0;
+
+            void parse(const unsigned char* data, size_t length);
+            void extractPngs();
+    };
+
+    void ImageCollector::collect() {
+        while (decoderReader.available() > 0) {
+            size_t length = std::min(decoderReader.available(), encoderInput.writeable());
+            if (length > 0) {
+                parse(decoderReader.getReadPointer(), length);
+                std::memcpy(encoderInput.getWritePointer(), decoderReader.getReadPointer(), length);
+                encoderInput.advance(length);
+                decoderReader.advance(length);
+            }
+            while (encoder.canProcess()) encoder.process();
+            size_t available = encoderOutputReader.available();
+            png.insert(png.end(), encoderOutputReader.getReadPointer(), encoderOutputReader.getReadPointer() + available);
+            encoderOutputReader.advance(available);
+            extractPngs();
+        }
+    }
+
+    void ImageCollector::parse(const unsigned char* data, size_t length) {
+        const size_t headerLength = sizeof(outputSync) + sizeof(OutputDescription);
+        const size_t endLength = sizeof(endSync) + sizeof(EndDescription);
+        while (length > 0) {
+            if (remaining > 0) {
+                size_t amount = std::min(remaining, length);
+                remaining -= amount;
+                data += amount;
+                length -= amount;
+                if (remaining == 0) images.back().complete = true;
+                continue;
+            }
+            // read the marker first to find out what kind of record follows
+            size_t needed = sizeof(outputSync);
+            if (header.size() >= sizeof(outputSync)) {
+                needed = std::memcmp(header.data(), endSync, sizeof(endSync)) == 0 ? endLength : headerLength;
+            }
+            size_t amount = std::min(needed - header.size(), length);
+            header.insert(header.end(), data, data + amount);
+            data += amount;
+            length -= amount;
+            if (header.size() < needed) break;
+            // the marker is complete, now read the rest of the record
+            if (needed == sizeof(outputSync)) continue;
+            if (needed == endLength) {
+                if (!images.empty()) {
+                    images.back().ended = true;
+                    std::memcpy(&images.back().end, header.data() + sizeof(endSync), sizeof(EndDescription));
+                }
+                header.clear();
+                continue;
+            }
+            ImageResult image;
+            std::memcpy(&image.description, header.data() + sizeof(outputSync), sizeof(OutputDescription));
+            header.clear();
+            remaining = (size_t) image.description.pixels * image.description.lines * 3;
+            image.complete = remaining == 0;
+            images.push_back(image);
+        }
+    }
+
+    void ImageCollector::extractPngs() {
+        // walk the chunks of the PNG at the start of the buffer until its IEND chunk
+        const size_t signatureLength = 8;
+        size_t position = signatureLength;
+        while (position + 12 <= png.size()) {
+            const unsigned char* chunk = png.data() + position;
+            size_t chunkLength = (size_t) chunk[0] << 24 | (size_t) chunk[1] << 16 | (size_t) chunk[2] << 8 | chunk[3];
+            if (position + 12 + chunkLength > png.size()) return;
+            bool end = std::memcmp(chunk + 4, "IEND", 4) == 0;
+            position += 12 + chunkLength;
+            if (!end) continue;
+
+            std::string name = prefix + "-" + std::to_string(++pngCount) + ".png";
+            FILE* file = fopen(name.c_str(), "wb");
+            if (file != nullptr) {
+                fwrite(png.data(), 1, position, file);
+                fclose(file);
+                if (pngCount <= images.size()) images[pngCount - 1].file = name.substr(name.find_last_of('/') + 1);
+            } else {
+                fprintf(stderr, "could not write %s: %s\n", name.c_str(), std::strerror(errno));
+            }
+            png.erase(png.begin(), png.begin() + (long) position);
+            position = signatureLength;
+        }
+    }
+
+    template <typename T, typename Decoder>
+    void decode(Decoder& decoder, T* data, size_t length, ImageCollector& collector) {
+        Csdr::MemoryReader<T> reader(data, length);
+        decoder.setReader(&reader);
+        decoder.setWriter(collector.getWriter());
+        while (decoder.canProcess()) {
+            decoder.process();
+            collector.collect();
+        }
+    }
+
+    // converts the audio one block at a time while decoding, so that the analytic signal of the whole recording
+    // never needs to be in memory
+    void decode(ComplexSstvDecoder& decoder, Recording& recording, ImageCollector& collector) {
+        const size_t blockSize = 4096;
+        Csdr::Ringbuffer<Csdr::complex<float>> input(blockSize * 4);
+        Csdr::RingbufferReader<Csdr::complex<float>> reader(&input);
+        decoder.setReader(&reader);
+        decoder.setWriter(collector.getWriter());
+        size_t position = 0;
+        while (position < recording.getPaddedLength()) {
+            size_t length = std::min(std::min(blockSize, input.writeable()), recording.getPaddedLength() - position);
+            recording.getSignal(position, length, input.getWritePointer());
+            input.advance(length);
+            position += length;
+            while (decoder.canProcess()) {
+                decoder.process();
+                collector.collect();
+            }
+        }
+    }
+
+    void copyStatistics(const DecoderStatistics& statistics, FileResult& result) {
+        result.visDecoded = statistics.visDecoded.get();
+        result.probeDecoded = statistics.probeDecoded.get();
+        result.linesDecoded = statistics.linesDecoded.get();
+        result.imagesAborted = statistics.imagesAborted.get();
+        result.imagesPreempted = statistics.imagesPreempted.get();
+        result.lineSyncHits = statistics.lineSyncHits.get();
+        result.lineSyncTimeouts = statistics.lineSyncTimeouts.get();
+    }
+
+    std::string getBaseName(const std::string& name) {
+        size_t dot = name.find_last_of('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+
+    FileResult decodeFile(const Options& options, const std::string& name) {
+        FileResult result;
+        result.name = name;
+        Recording* recording = Recording::open(options.inputDirectory + "/" + name, options.trackSampleRate, padding, result.error);
+        if (recording == nullptr) return result;
+
+        result.format = recording->getFormat();
+        result.sampleRate = recording->getSampleRate();
+        result.samples = recording->getLength();
+        result.decimation = options.decimation > 0 ? options.decimation : std::max(1u, (unsigned int) (result.sampleRate / 12000));
+        ImageCollector collector(options.outputDirectory + "/" + getBaseName(name), result.images, options.verbose);
+
+        auto start = std::chrono::steady_clock::now();
+        if (recording->getFormat() == AUDIO) {
+            ComplexSstvDecoder decoder(result.sampleRate, result.decimation);
+            if (!options.verbose) decoder.getDecoder().setLogSink(nullptr);
+            decoder.getDecoder().setHeaderHunt(options.headerHunt);
+            decoder.getDecoder().setEndRecords(true);
+            decode(decoder, *recording, collector);
+            copyStatistics(decoder.getDecoder().getStatistics(), result);
+        } else {
+            SstvDecoder decoder(result.sampleRate, result.decimation);
+            if (!options.verbose) decoder.setLogSink(nullptr);
+            decoder.setHeaderHunt(options.headerHunt);
+            decoder.setEndRecords(true);
+            decode(decoder, recording->getTrack(), recording->getPaddedLength(), collector);
+            copyStatistics(decoder.getStatistics(), result);
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        delete recording;
+        return result;
+    }
+
+    std::string escapeJson(const std::string& value) {
+        std::string escaped;
+        for (char c: value) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if ((unsigned char) c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped += code;
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    // JSON has no representation for infinity or NaN
+    std::string formatNumber(double value) {
+        if (!std::isfinite(value)) return "null";
+        char number[32];
+        snprintf(number, sizeof(number), "%.6g", value);
+        return number;
+    }
+
+    bool writeSummary(const std::string& path, const FileResult& result) {
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == nullptr) return false;
+        // offsets are reported in Hz at the rate the decoder runs at
+        double nyquist = result.sampleRate / (float) result.decimation / 2;
+        fprintf(file, "{\n");
+        fprintf(file, "  \"file\": \"%s\",\n", escapeJson(result.name).c_str());
+        fprintf(file, "  \"format\": \"%s\",\n", result.format == AUDIO ? "audio" : "track");
+        fprintf(file, "  \"sampleRate\": %s,\n", formatNumber(result.sampleRate).c_str());
+        fprintf(file, "  \"decimation\": %u,\n", result.decimation);
+        fprintf(file, "  \"samples\": %zu,\n", result.samples);
+        fprintf(file, "  \"duration\": %s,\n", formatNumber((double) result.samples / result.sampleRate).c_str());
+        fprintf(file, "  \"decodingTime\": %s,\n", formatNumber(result.seconds).c_str());
+        fprintf(file, "  \"samplesPerSecond\": %s,\n", formatNumber((double) result.samples / result.seconds).c_str());
+        fprintf(file, "  \"images\": [");
+        for (size_t i = 0; i < result.images.size(); i++) {
+            const ImageResult& image = result.images[i];
+            fprintf(file, "%s\n    {\n", i > 0 ? "," : "");
+            fprintf(file, "      \"vis\": %u,\n", image.description.vis);
+            const char* mode = Mode::getName(image.description.vis);
+            if (mode == nullptr) {
+                fprintf(file, "      \"mode\": null,\n");
+            } else {
+                fprintf(file, "      \"mode\": \"%s\",\n", escapeJson(mode).c_str());
+            }
+            fprintf(file, "      \"pixels\": %u,\n", image.description.pixels);
+            fprintf(file, "      \"lines\": %u,\n", image.description.lines);
+            fprintf(file, "      \"complete\": %s,\n", image.complete ? "true" : "false");
+            if (image.ended) {
+                fprintf(file, "      \"decodedLines\": %u,\n", image.end.lines);
+                fprintf(file, "      \"signalLost\": %s,\n", image.end.reason == END_SIGNAL_LOST ? "true" : "false");
+                fprintf(file, "      \"preempted\": %s,\n", image.end.reason == END_PREEMPTED ? "true" : "false");
+            } else {
+                fprintf(file, "      \"decodedLines\": null,\n");
+                fprintf(file, "      \"signalLost\": null,\n");
+                fprintf(file, "      \"preempted\": null,\n");
+            }
+            fprintf(file, "      \"syncError\": %s,\n", formatNumber(image.description.error).c_str());
+            fprintf(file, "      \"visError\": %s,\n", formatNumber(image.description.visError).c_str());
+            fprintf(file, "      \"offset\": %s,\n", formatNumber(image.description.offset * nyquist).c_str());
+            if (image.file.empty()) {
+                fprintf(file, "      \"png\": null\n");
+            } else {
+                fprintf(file, "      \"png\": \"%s\"\n", escapeJson(image.file).c_str());
+            }
+            fprintf(file, "    }");
+        }
+        fprintf(file, "%s],\n", result.images.empty() ? "" : "\n  ");
+        fprintf(file, "  \"statistics\": {\n");
+        fprintf(file, "    \"visDecoded\": %llu,\n", (unsigned long long) result.visDecoded);
+        fprintf(file, "    \"probeDecoded\": %llu,\n", (unsigned long long) result.probeDecoded);
+        fprintf(file, "    \"linesDecoded\": %llu,\n", (unsigned long long) result.linesDecoded);
+        fprintf(file, "    \"imagesAborted\": %llu,\n", (unsigned long long) result.imagesAborted);
+        fprintf(file, "    \"imagesPreempted\": %llu,\n", (unsigned long long) result.imagesPreempted);
+        fprintf(file, "    \"lineSyncHits\": %llu,\n", (unsigned long long) result.lineSyncHits);
+        fprintf(file, "    \"lineSyncTimeouts\": %llu\n", (unsigned long long) result.lineSyncTimeouts);
+        fprintf(file, "  }\n");
+        fprintf(file, "}\n");
+        return fclose(file) == 0;
+    }
+
+    bool listRecordings(const std::string& directory, std::vector<std::string>& names) {
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) return false;
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (!Recording::isSupported(name)) continue;
+            struct stat info;
+            if (stat((directory + "/" + name).c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+            names.push_back(name);
+        }
+        closedir(dir);
+        // process and report in a stable order
+        std::sort(names.begin(), names.end());
+        return true;
+    }
+
+    void printUsage(const char* program) {
+        fprintf(stderr,
+            "usage: %s [options] <input directory> <output directory>\n"
+            "\n"
+            "decodes all recordings in the input directory. frequency tracks (.f32, .raw) contain float32 samples\n"
+            "normalized to the nyquist frequency, audio files (.wav) contain 16 bit PCM or 32 bit float samples.\n"
+            "every image is written to a PNG file, and a JSON summary is written per recording.\n"
+            "\n"
+            "options:\n"
+            "  -r <rate>    sample rate of frequency track files (default 12000)\n"
+            "  -d <factor>  decimation factor (default: sample rate / 12000)\n"
+            "  -j <count>   number of worker threads (default: number of cores)\n"
+            "  -p           end an image when the header of the next one turns up\n"
+            "  -v           show the decoder log\n",
+            program
+        );
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    int option;
+    while ((option = getopt(argc, argv, "r:d:j:pvh")) != -1) {
+        switch (option) {
+            case 'r':
+                options.trackSampleRate = std::strtof(optarg, nullptr);
+                break;
+            case 'd':
+                options.decimation = (unsigned int) std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'j':
+                options.threads = (unsigned int) std::strtoul(optarg, nullptr, 10);
+                break;
+            case 'p':
+                options.headerHunt = true;
+                break;
+            case 'v':
+                options.verbose = true;
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2 || options.trackSampleRate <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    options.inputDirectory = argv[optind];
+    options.outputDirectory = argv[optind + 1];
+
+    std::vector<std::string> names;
+    if (!listRecordings(options.inputDirectory, names)) {
+        fprintf(stderr, "could not read %s: %s\n", options.inputDirectory.c_str(), std::strerror(errno));
+        return 1;
+    }
+    if (mkdir(options.outputDirectory.c_str(), 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "could not create %s: %s\n", options.outputDirectory.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    unsigned int threads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, (unsigned int) std::max(names.size(), (size_t) 1));
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex outputMutex;
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back([&] {
+            size_t index;
+            while ((index = next.fetch_add(1)) < names.size()) {
+                FileResult result = decodeFile(options, names[index]);
+                std::string summary = options.outputDirectory + "/" + getBaseName(names[index]) + ".json";
+                bool written = result.error.empty() && writeSummary(summary, result);
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                if (!result.error.empty()) {
+                    fprintf(stderr, "%s: %s\n", result.name.c_str(), result.error.c_str());
+                    failed = true;
+                } else if (!written) {
+                    fprintf(stderr, "could not write %s: %s\n", summary.c_str(), std::strerror(errno));
+                    failed = true;
+                } else {
+                    printf(
+                        "%s: %zu image(s), %.2f s, %.0f samples/s\n",
+                        result.name.c_str(),
+                        result.images.size(),
+                        result.seconds,
+                        (double) result.samples / result.seconds
+                    );
+                }
+            }
+        });
+    }
+    for (auto& worker: workers) worker.join();
+    return failed ? 1 : 0;
+}
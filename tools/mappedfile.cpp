@@ -0,0 +1,54 @@
+#include "mappedfile.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Csdr::Sstv::Tools;
+
+MappedFile::MappedFile(const std::string& path, size_t padding) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = std::strerror(errno);
+        ::close(fd);
+        return;
+    }
+    size = (size_t) info.st_size;
+    mappedSize = size + padding;
+    if (mappedSize == 0) {
+        error = "empty file";
+        ::close(fd);
+        return;
+    }
+
+    // reserve zeroed memory for the file and the padding, then map the file over the start of it. the kernel fills
+    // the rest of the last page of the file with zeros as well.
+    void* base = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        error = std::strerror(errno);
+        ::close(fd);
+        return;
+    }
+    if (size > 0) {
+        if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            error = std::strerror(errno);
+            munmap(base, mappedSize);
+            ::close(fd);
+            return;
+        }
+        madvise(base, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    data = (unsigned char*) base;
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) munmap(data, mappedSize);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Csdr::Sstv::Tools {
+
+    // read-only memory mapping of a whole file, followed by a number of zero bytes. the padding lets consumers read a
+    // little past the end of the data without copying the file into a larger buffer.
+    class MappedFile {
+        public:
+            MappedFile(const std::string& path, size_t padding);
+            ~MappedFile();
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            bool isValid() const { return data != nullptr; }
+            // reason for the failure if the file could not be mapped
+            const std::string& getError() const { return error; }
+            const unsigned char* getData() const { return data; }
+            // size of the file, without the padding
+            size_t getSize() const { return size; }
+        private:
+            unsigned char* data = nullptr;
+            size_t size = 0;
+            size_t mappedSize = 0;
+            std::string error;
+    };
+
+}
@@ -0,0 +1,155 @@
+#include "recording.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace Csdr::Sstv::Tools;
+
+namespace {
+
+    bool hasExtension(const std::string& path, const std::string& extension) {
+        if (path.size() < extension.size()) return false;
+        std::string end = path.substr(path.size() - extension.size());
+        std::transform(end.begin(), end.end(), end.begin(), ::tolower);
+        return end == extension;
+    }
+
+    uint16_t getUint16(const unsigned char* data) {
+        return (uint16_t) (data[0] | data[1] << 8);
+    }
+
+    uint32_t getUint32(const unsigned char* data) {
+        return (uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+    }
+
+}
+
+bool Recording::isSupported(const std::string& path) {
+    return hasExtension(path, ".f32") || hasExtension(path, ".raw") || hasExtension(path, ".wav");
+}
+
+Recording* Recording::open(const std::string& path, float trackSampleRate, double padding, std::string& error) {
+    if (hasExtension(path, ".wav")) {
+        // the audio is converted, so the mapping doesn't need any padding
+        auto file = new MappedFile(path, 0);
+        if (!file->isValid()) {
+            error = file->getError();
+            delete file;
+            return nullptr;
+        }
+        auto recording = new Recording(AUDIO, file);
+        if (!recording->loadWav(padding, error)) {
+            delete recording;
+            return nullptr;
+        }
+        return recording;
+    }
+
+    auto paddingSamples = (size_t) (padding * trackSampleRate);
+    auto file = new MappedFile(path, paddingSamples * sizeof(float));
+    if (!file->isValid()) {
+        error = file->getError();
+        delete file;
+        return nullptr;
+    }
+    auto recording = new Recording(TRACK, file);
+    recording->sampleRate = trackSampleRate;
+    recording->length = file->getSize() / sizeof(float);
+    recording->paddedLength = recording->length + paddingSamples;
+    return recording;
+}
+
+Recording::~Recording() {
+    delete file;
+}
+
+bool Recording::loadWav(double padding, std::string& error) {
+    const unsigned char* data = file->getData();
+    size_t size = file->getSize();
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        error = "not a WAV file";
+        return false;
+    }
+
+    uint16_t formatTag = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    size_t sampleBytes = 0;
+    size_t position = 12;
+    while (position + 8 <= size && samples == nullptr) {
+        uint32_t chunkSize = getUint32(data + position + 4);
+        const unsigned char* chunk = data + position + 8;
+        size_t available = std::min((size_t) chunkSize, size - position - 8);
+        if (std::memcmp(data + position, "fmt ", 4) == 0 && available >= 16) {
+            formatTag = getUint16(chunk);
+            channels = getUint16(chunk + 2);
+            rate = getUint32(chunk + 4);
+            bits = getUint16(chunk + 14);
+            // WAVE_FORMAT_EXTENSIBLE has the actual format at the start of the sub format GUID
+            if (formatTag == 0xFFFE && available >= 26) formatTag = getUint16(chunk + 24);
+        } else if (std::memcmp(data + position, "data", 4) == 0) {
+            samples = chunk;
+            sampleBytes = available;
+        }
+        // chunks are padded to an even size
+        position += 8 + (size_t) chunkSize + (chunkSize & 1);
+    }
+    if (samples == nullptr || channels == 0 || rate == 0) {
+        error = "incomplete WAV header";
+        return false;
+    }
+    pcm16 = formatTag == 1 && bits == 16;
+    bool float32 = formatTag == 3 && bits == 32;
+    if (!pcm16 && !float32) {
+        error = "unsupported WAV sample format, only 16 bit PCM and 32 bit float are supported";
+        return false;
+    }
+
+    frameBytes = (size_t) channels * bits / 8;
+    sampleRate = (float) rate;
+    length = sampleBytes / frameBytes;
+    paddedLength = length + (size_t) (padding * sampleRate);
+    createHilbertTaps();
+    return true;
+}
+
+float Recording::getAudioSample(size_t index) const {
+    const unsigned char* frame = samples + index * frameBytes;
+    if (pcm16) return (float) (int16_t) getUint16(frame) / 32768.0f;
+    uint32_t bitPattern = getUint32(frame);
+    float value;
+    std::memcpy(&value, &bitPattern, sizeof(float));
+    return value;
+}
+
+void Recording::createHilbertTaps() {
+    // hilbert transformer. the taps are antisymmetric and every other one is zero, so only the odd ones on one side
+    // are stored. the length reaches down to about 200Hz, well below the SSTV band.
+    size_t half = (size_t) (sampleRate / 200);
+    taps.clear();
+    for (size_t n = 1; n <= half; n += 2) {
+        // blackman window
+        double window = .42 + .5 * cos(M_PI * (double) n / (double) (half + 1)) + .08 * cos(2 * M_PI * (double) n / (double) (half + 1));
+        taps.push_back((float) (2.0 / (M_PI * (double) n) * window));
+    }
+}
+
+void Recording::getSignal(size_t position, size_t count, Csdr::complex<float>* dst) {
+    // the filter reaches this far to either side
+    size_t history = taps.size() * 2;
+    audio.resize(count + 2 * history);
+    for (size_t i = 0; i < audio.size(); i++) {
+        // before the start and after the end of the file is silence
+        size_t index = position + i - history;
+        audio[i] = position + i >= history && index < length ? getAudioSample(index) : 0.0f;
+    }
+    for (size_t k = 0; k < count; k++) {
+        const float* center = audio.data() + history + k;
+        float q = 0.0;
+        for (size_t i = 0; i < taps.size(); i++) {
+            size_t n = 2 * i + 1;
+            q += taps[i] * (center[-(long) n] - center[n]);
+        }
+        dst[k] = Csdr::complex<float>(*center, q);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "mappedfile.hpp"
+#include <csdr/complex.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Csdr::Sstv::Tools {
+
+    enum RecordingFormat { TRACK, AUDIO };
+
+    // an input file for offline decoding, followed by some silence so that the decoder's lookahead can reach the end
+    // of the recording.
+    // frequency tracks (.f32 or .raw, float32 normalized to the nyquist frequency like the SstvDecoder input) are
+    // decoded straight from the memory mapping. audio (.wav, 16 bit PCM or 32 bit float, first channel only) is
+    // turned into an analytic signal for the ComplexSstvDecoder, one block at a time.
+    class Recording {
+        public:
+            // true if the file name has one of the supported extensions
+            static bool isSupported(const std::string& path);
+            // trackSampleRate is the sample rate of frequency track files, which have no header. padding is in
+            // seconds. returns nullptr and sets error if the file cannot be used.
+            static Recording* open(const std::string& path, float trackSampleRate, double padding, std::string& error);
+            ~Recording();
+            RecordingFormat getFormat() const { return format; }
+            float getSampleRate() const { return sampleRate; }
+            // number of samples in the file
+            size_t getLength() const { return length; }
+            // number of samples including the padding
+            size_t getPaddedLength() const { return paddedLength; }
+            // only for TRACK recordings
+            float* getTrack() const { return (float*) file->getData(); }
+            // only for AUDIO recordings: converts count samples of the analytic signal, starting at position. the
+            // padding is silence.
+            void getSignal(size_t position, size_t count, Csdr::complex<float>* dst);
+        private:
+            Recording(RecordingFormat format, MappedFile* file): format(format), file(file) {}
+            RecordingFormat format;
+            MappedFile* file;
+            float sampleRate = 0.0;
+            size_t length = 0;
+            size_t paddedLength = 0;
+            // the WAV sample data
+            const unsigned char* samples = nullptr;
+            size_t frameBytes = 0;
+            bool pcm16 = false;
+            // hilbert transformer, see createHilbertTaps()
+            std::vector<float> taps;
+            // audio of the block that is being converted, including the filter history on both sides
+            std::vector<float> audio;
+
+            bool loadWav(double padding, std::string& error);
+            void createHilbertTaps();
+            float getAudioSample(size_t index) const;
+    };
+
+}